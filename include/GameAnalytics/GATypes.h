@@ -9,6 +9,8 @@
 #include <cstring>
 #include <array>
 #include <functional>
+#include <chrono>
+#include <future>
 
 namespace gameanalytics
 {
@@ -73,6 +75,114 @@ namespace gameanalytics
         LogVerbose  = 4
     };
 
+    /*!
+     @enum
+     @discussion
+     this enum is used to specify what happens to an event when the event queue is full
+     @constant QueueBlockWithTimeout
+     The calling thread waits for room in the queue, the event is dropped if the timeout expires
+     @constant QueueDropNewest
+     The new event is dropped
+     @constant QueueDropOldestLowPriority
+     The oldest queued low priority event (design, resource and progression) is dropped to make room
+     @constant QueueCoalesce
+     Calls which only overwrite a setting replace a pending call of the same kind, other events are dropped
+     */
+    enum EGAQueueOverflowPolicy
+    {
+        QueueBlockWithTimeout      = 0,
+        QueueDropNewest            = 1,
+        QueueDropOldestLowPriority = 2,
+        QueueCoalesce              = 3
+    };
+
+    /*!
+     @enum
+     @discussion
+     this enum is returned by flush
+     @constant FlushUploaded
+     All events were stored and sent to the collector
+     @constant FlushPersisted
+     All events were stored, some could not be sent before the timeout (or the collector was not reachable) and will be sent later
+     @constant FlushTimedOut
+     Some events were still waiting to be stored when the timeout expired
+     */
+    enum EGAFlushStatus
+    {
+        FlushUploaded  = 0,
+        FlushPersisted = 1,
+        FlushTimedOut  = 2
+    };
+
+    /*!
+     @enum
+     @discussion
+     this enum is used to specify the scheduling policy of the SDK's threads (Linux only)
+     @constant ThreadSchedulingNormal
+     Inherited from the thread initializing the SDK
+     @constant ThreadSchedulingBatch
+     SCHED_BATCH, for cpu bound work which should not preempt interactive threads
+     @constant ThreadSchedulingIdle
+     SCHED_IDLE, only runs when nothing else wants the core
+     */
+    enum EGAThreadSchedulingPolicy
+    {
+        ThreadSchedulingNormal = 0,
+        ThreadSchedulingBatch  = 1,
+        ThreadSchedulingIdle   = 2
+    };
+
+    /*!
+     @enum
+     @discussion
+     this enum is used to specify how the SDK's event database trades durability for write speed
+     @constant StorageDurable
+     Rollback journal with synchronous=FULL, every stored event survives a power loss. Each event costs several fsyncs
+     @constant StorageBalanced
+     WAL with synchronous=NORMAL (default), survives application crashes, the last events before a power loss or OS crash may be lost
+     @constant StorageFast
+     WAL with synchronous=OFF, survives application crashes, a power loss or OS crash may lose events or corrupt the database (it is recreated then)
+     */
+    enum EGAStorageProfile
+    {
+        StorageDurable  = 0,
+        StorageBalanced = 1,
+        StorageFast     = 2
+    };
+
+    /*!
+     @enum
+     @discussion
+     this enum is used to specify where events wait until they are sent
+     @constant EventStoreSqlite
+     A table in the SDK's database (default)
+     @constant EventStoreLog
+     Append-only log files next to the database, events are written sequentially and sent in the order they were added
+     */
+    enum EGAEventStoreType
+    {
+        EventStoreSqlite = 0,
+        EventStoreLog    = 1
+    };
+
+    /*!
+     @enum
+     @discussion
+     this enum is used to specify what decides whether a sampled event is kept
+     @constant SamplePerEvent
+     Every event is kept or dropped at random
+     @constant SamplePerUser
+     All events of a user are kept or dropped, the same users are kept by every rule with the same or a higher rate
+     @constant SamplePerEventId
+     All events with the same event id are kept or dropped, on every device
+     */
+    enum EGASamplingMode
+    {
+        SamplePerEvent   = 0,
+        SamplePerUser    = 1,
+        SamplePerEventId = 2
+    };
+
     using StringVector = std::vector<std::string>;
 
     using LogHandler = std::function<void(std::string const&, EGALoggerMessageType)>;
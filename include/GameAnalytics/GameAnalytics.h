@@ -44,6 +44,78 @@ namespace gameanalytics
 
          static void configureBuild(std::string const& build);
          static void configureWritablePath(std::string const& writablePath);
+         // journaling and sync mode of the event database, see EGAStorageProfile. Has to be set before initialize
+         static void configureStorageProfile(EGAStorageProfile profile);
+         // where events wait until they are uploaded, see EGAEventStoreType. Has to be set before initialize
+         static void configureEventStore(EGAEventStoreType type);
+
+         /**
+          * @brief: events stored while the SDK works through a backlog are committed in one transaction instead of one each.
+          *         Disabled by default. While enabled a crash loses the open transaction, up to maxBatchSize writes or
+          *         maxLatencyMs worth of events. flush and whenEventsPersisted commit right away
+          *
+          * @param enabled: false commits every event on its own
+          * @param maxBatchSize: number of writes after which the transaction is committed
+          * @param maxLatencyMs: longest time the transaction stays open
+          */
+         static void configureGroupCommit(bool enabled, int maxBatchSize = 256, int maxLatencyMs = 50);
+
+         /**
+          * @brief: limits the disk space taken by events waiting to be sent. Past it health, design, progression, resource,
+          *         error and sdk init events are evicted in that order, oldest first. Session and business events are kept
+          *
+          * @param maxBytes: budget in bytes, 6 MB by default
+          */
+         static void configureStorageBudget(int maxBytes);
+
+         /**
+          * @brief: stores the annotation fields which events share (sdk, os, device, user, session, ...) once per session
+          *         instead of in every stored event, so the storage budget holds several times more offline events.
+          *         Uploaded events are unchanged
+          *
+          * @param enabled: off by default
+          */
+         static void configureCompactEventStorage(bool enabled);
+
+         /**
+          * @brief: keeps only a share of the matching events and caps how many of them are added per second, checked on the
+          *         calling thread before anything is queued. Kept events of a rule with a rate below 1 get the custom field
+          *         ga_sample_rate. The remote config "ga_sampling" (a json array of rules) overrides rules with the same
+          *         category and prefix. Business events are never sampled
+          *
+          * @param category: design, progression, resource or error, empty for all of them
+          * @param eventIdPrefix: matched against the design event id, "progression01:progression02:progression03",
+          *        "currency:itemType:itemId" of resource events and the severity of error events. The longest prefix wins
+          * @param sampleRate: share of the events which is kept, from 0 to 1
+          * @param mode: what decides whether an event is kept. SamplePerUser samples per event until the user id is known
+          * @param maxEventsPerSecond: rate of the token bucket the kept events take from, 0 for no limit. A remote config
+          *        refresh keeps the tokens left while the rate and burst of the rule stay the same
+          * @param burst: events which can be added at once after a quiet period, one second worth by default
+          */
+         static void configureEventSampling(std::string const& category, std::string const& eventIdPrefix, double sampleRate, EGASamplingMode mode = SamplePerEvent, double maxEventsPerSecond = 0, int burst = 0);
+
+         /**
+          * @brief: keeps events in memory and uploads them from there, the event database is only written to periodically,
+          *         when the buffer is full, when an upload fails and on suspend/quit. Events still in memory are lost if the app crashes
+          *
+          * @param enabled: true to buffer events, session start and end are always stored right away
+          * @param maxEvents: number of buffered events after which they are written to the database
+          * @param spillIntervalMs: how often the buffered events are written to the database
+          */
+         static void configureWriteBehindBuffer(bool enabled, int maxEvents = 1000, int spillIntervalMs = 30000);
+
+         /**
+          * @brief: folds design events with the same event id, custom fields and dimensions added within the window into
+          *         one event. Its value is the sum of the values and it gets the custom fields ga_count, ga_min and ga_max.
+          *         Events without a value only get ga_count. When the custom fields would go over the limit, the caller's
+          *         fields last in alphabetical order of their keys are dropped to make room, ga_sample_rate is kept.
+          *         A single event is stored as it was added. Events are stored at the end of the window, on session end,
+          *         flush and suspend/quit
+          *
+          * @param enabled: off by default
+          * @param windowMs: how long events are folded before they are stored
+          */
+         static void configureDesignEventAggregation(bool enabled, int windowMs = 10000);
          static void configureBuildPlatform(std::string const& platform);
          static void configureCustomLogHandler(const LogHandler &logHandler);
          static void disableDeviceInfo();
@@ -61,6 +133,49 @@ namespace gameanalytics
         
          static void configureExternalUserId(std::string const& extId);
 
+         /**
+          * @brief: limits how many calls can be waiting on the SDK thread, takes effect immediately.
+          *         QueueDropOldestLowPriority and QueueCoalesce search the waiting calls, so they are queued behind a lock
+          *         instead of the lock-free ring buffer and events are not staged while one of them is set
+          *
+          * @param capacity: maximum number of queued calls, session and configuration calls are never dropped
+          * @param policy: what happens to an event added while the queue is full
+          * @param blockTimeoutMs: how long the caller waits for room with QueueBlockWithTimeout
+          */
+         static void configureEventQueue(int capacity, EGAQueueOverflowPolicy policy, int blockTimeoutMs = 100);
+
+         /**
+          * @brief: events are collected per calling thread and handed to the SDK thread in batches instead of one by one.
+          *         Staged events count against the capacity of configureEventQueue and its policy applies to them when they are staged
+          *
+          * @param enabled: true to stage events, session and configuration calls are always queued right away
+          * @param batchSize: number of events after which a thread hands its batch over
+          * @param maxDelayMs: longest time an event waits in a staging buffer
+          */
+         static void configureEventStaging(bool enabled, int batchSize = 64, int maxDelayMs = 20);
+
+         /**
+          * @brief: the SDK starts no threads of its own, the host runs its work by calling pump(). Has to be the first call to the SDK
+          *
+          * @param enabled: true to enable the external pump mode
+          */
+         static void configureExternalPump(bool enabled = true);
+
+         /**
+          * @brief: runs queued SDK work, due timers and pending uploads in external pump mode
+          *
+          * @param timeBudgetMs: no new work is started once the budget is spent, an upload in progress blocks until its request finishes
+          */
+         static void pump(int timeBudgetMs);
+
+         // placement of the SDK's threads (Linux only), should be called before initialize
+         // cpus: cores the SDK's threads may run on, an empty list leaves the affinity unchanged
+         static void configureThreadAffinity(std::vector<int> const& cpus);
+         // niceValue: applied when non zero, raising priority (negative values) needs privileges
+         static void configureThreadScheduling(EGAThreadSchedulingPolicy policy, int niceValue = 0);
+         // shown in top/perf, the upload thread gets an "-io" suffix. Names are cut to 15 characters
+         static void configureThreadName(std::string const& name);
+
          // initialize - starting SDK (need configuration before starting)
          static void initialize(std::string const& gameKey, std::string const& gameSecret);
 
@@ -94,11 +209,29 @@ namespace gameanalytics
          static void enableMemoryHistogram(bool value = true);
          static void enableFPSHistogram(FPSTracker fpsTracker, bool value = true);
          static void enableHardwareTracking(bool value = true);
+         // adds the sdk's own queue and latency stats (see getSdkStats) to the health event
+         static void enableSdkStatsInHealthEvent(bool value = true);
 
          ///////////
 
          static void setGlobalCustomEventFields(std::string const& customFields);
 
+         /**
+          * @brief: stores all events added so far and sends them to the collector, waiting at most for the given timeout.
+          * Can't be called from the SDK thread (or from inside pump)
+          *
+          * @param timeout: time after which flush gives up, any upload in progress carries on in the background
+          * @return how far the events got before the timeout
+          */
+         static EGAFlushStatus flush(std::chrono::milliseconds timeout);
+
+         /**
+          * @brief: completion for the calls made so far from this thread, the SDK processes calls in order
+          *
+          * @return a future which is ready once all previous calls were processed and their events stored
+          */
+         static std::future<void> whenEventsPersisted();
+
          static void startSession();
          static void endSession();
 
@@ -121,6 +254,13 @@ namespace gameanalytics
          static int64_t getElapsedSessionTime();
          static int64_t getElapsedTimeFromAllSessions();
 
+         // number of events dropped because the event queue was full, for all categories if category is empty
+         static int64_t getDroppedEventCount(std::string const& category = "");
+
+         // json with the sdk's queue depth, wait and run time per task kind (in microseconds), tasks per second, longest stall
+         // and the disk space taken by stored events
+         static std::string getSdkStats();
+
          // game state changes
          // will affect how session is started / ended
          static void onResume();
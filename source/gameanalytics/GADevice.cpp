@@ -7,6 +7,7 @@
 #include "GAUtilities.h"
 #include "Platform/GADevicePlatform.h"
 #include "GAState.h"
+#include "GALogger.h"
 
 namespace gameanalytics
 {
@@ -54,6 +55,7 @@ namespace gameanalytics
         void GADevice::setSdkGameEngineVersion(std::string const& sdkGameEngineVersion)
         {
             getInstance()._sdkGameEngineVersion = sdkGameEngineVersion;
+            state::GAState::invalidateAnnotations();
         }
 
         std::string GADevice::getGameEngineVersion()
@@ -64,19 +66,83 @@ namespace gameanalytics
         void GADevice::setGameEngineVersion(std::string const& gameEngineVersion)
         {
             getInstance()._gameEngineVersion = gameEngineVersion;
+            state::GAState::invalidateAnnotations();
         }
 
         void GADevice::setConnectionType(std::string const& connectionType)
         {
+            std::lock_guard<std::mutex> lock(getInstance()._connectionMutex);
             getInstance()._connectionType = connectionType;
         }
 
         std::string GADevice::getConnectionType()
         {
-            if(getInstance()._platform)
-                return getInstance()._platform->getConnectionType();
+            GADevice& device = getInstance();
+            if(!device._platform)
+                return "";
 
-            return "";
+            {
+                std::lock_guard<std::mutex> lock(device._connectionMutex);
+                if (!device._connectionType.empty())
+                {
+                    return device._connectionType;
+                }
+            }
+
+            // first use, updateConnectionType keeps it current from now on
+            const std::string connectionType = device._platform->getConnectionType();
+
+            std::lock_guard<std::mutex> lock(device._connectionMutex);
+            if (device._connectionType.empty())
+            {
+                device._connectionType = connectionType;
+                device._connectionUpdated = std::chrono::steady_clock::now();
+            }
+
+            return device._connectionType;
+        }
+
+        bool GADevice::updateConnectionType()
+        {
+            GADevice& device = getInstance();
+            if(!device._platform)
+                return false;
+
+            if (!device._isWatchingConnection)
+            {
+                device._isWatchingConnection = device._platform->watchConnection();
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (device._isWatchingConnection)
+            {
+                if (!device._platform->connectionChanged())
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(device._connectionMutex);
+                if (now - device._connectionUpdated < ConnectionPollInterval)
+                {
+                    return false;
+                }
+            }
+
+            const std::string connectionType = device._platform->getConnectionType();
+
+            std::lock_guard<std::mutex> lock(device._connectionMutex);
+            device._connectionUpdated = now;
+            if (connectionType == device._connectionType)
+            {
+                return false;
+            }
+
+            logging::GALogger::d("Connection type changed: %s -> %s", device._connectionType.c_str(), connectionType.c_str());
+            device._connectionType = connectionType;
+
+            return true;
         }
 
         std::string GADevice::getRelevantSdkVersion()
@@ -102,6 +168,7 @@ namespace gameanalytics
         void GADevice::setBuildPlatform(std::string const& platform)
         {
             getInstance()._buildPlatform = platform;
+            state::GAState::invalidateAnnotations();
         }
 
         std::string GADevice::getOSVersion()
@@ -124,6 +191,8 @@ namespace gameanalytics
             {
                 getInstance()._deviceModel = deviceModel;
             }
+
+            state::GAState::invalidateAnnotations();
         }
 
         std::string GADevice::getDeviceModel()
@@ -139,6 +208,7 @@ namespace gameanalytics
         void GADevice::setDeviceManufacturer(std::string const& deviceManufacturer)
         {
             getInstance()._deviceManufacturer = deviceManufacturer;
+            state::GAState::invalidateAnnotations();
         }
 
         std::string GADevice::getDeviceManufacturer()
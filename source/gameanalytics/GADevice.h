@@ -8,6 +8,7 @@
 #include "GACommon.h"
 #include "GAHealth.h"
 #include "Platform/GAPlatform.h"
+#include <chrono>
 
 namespace gameanalytics
 {
@@ -33,7 +34,12 @@ namespace gameanalytics
                 static void         setGameEngineVersion(std::string const& gameEngineVersion);
                 static void         setConnectionType(std::string const& connectionType);
 
+                // the last connection type seen, cheap enough to be read for every event
                 static std::string  getConnectionType();
+
+                // looks the connection type up again if the platform reported a network change, or at a slow rate if it
+                // can't. Ga thread only, returns true if the type changed
+                static bool         updateConnectionType();
                 static std::string  getRelevantSdkVersion();
 
                 static std::string  getBuildPlatform();
@@ -69,6 +75,8 @@ namespace gameanalytics
                 void initRuntimePlatform();
                 void initPersistentPath();
 
+                static constexpr std::chrono::milliseconds ConnectionPollInterval{30000};
+
                 std::string _deviceId;
                 std::string _advertisingId;
 
@@ -86,6 +94,9 @@ namespace gameanalytics
                 std::string _sdkGameEngineVersion;
                 std::string _gameEngineVersion;
                 std::string _connectionType;
+                std::mutex  _connectionMutex;
+                bool        _isWatchingConnection = false;
+                std::chrono::steady_clock::time_point _connectionUpdated;
                 std::string _sdkWrapperVersion;
         };
     }
@@ -0,0 +1,356 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#include "GAEventSampler.h"
+#include "GALogger.h"
+#include <algorithm>
+#include <random>
+
+namespace gameanalytics
+{
+    namespace events
+    {
+        namespace
+        {
+            // maps the string to [0, 1), the same on every device
+            double hashToUnit(std::string const& value)
+            {
+                // FNV-1a
+                uint64_t hash = 14695981039346656037ull;
+                for (unsigned char c : value)
+                {
+                    hash ^= c;
+                    hash *= 1099511628211ull;
+                }
+
+                return static_cast<double>(hash >> 11) * 0x1.0p-53;
+            }
+
+            double randomUnit()
+            {
+                thread_local std::minstd_rand engine(std::random_device{}());
+                return std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+            }
+
+            int64_t steadyNanoseconds()
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // shared by every sampler, so a snapshot cached by a thread is never taken for the one of another sampler
+            std::atomic<uint64_t> rulesVersions{0};
+        }
+
+        void GAEventSampler::setRule(Rule const& rule)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            replaceRule(_localRules, rule);
+            activateRules();
+        }
+
+        void GAEventSampler::setRemoteRules(json const& rules)
+        {
+            std::vector<Rule> remoteRules;
+
+            try
+            {
+                // remote config values can be plain strings
+                const json parsed = rules.is_string() ? json::parse(rules.get<std::string>()) : rules;
+
+                if (parsed.is_array())
+                {
+                    for (json const& entry : parsed)
+                    {
+                        Rule rule;
+                        if (parseRule(entry, rule))
+                        {
+                            replaceRule(remoteRules, rule);
+                        }
+                        else
+                        {
+                            logging::GALogger::w("Ignored invalid sampling rule from remote config: %s", entry.dump().c_str());
+                        }
+                    }
+                }
+            }
+            catch (json::exception const& e)
+            {
+                logging::GALogger::w("Failed to parse the sampling rules of the remote config: %s", e.what());
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _remoteRules = std::move(remoteRules);
+            activateRules();
+        }
+
+        void GAEventSampler::setUserId(std::string const& userId)
+        {
+            _userUnit = userId.empty() ? -1.0 : hashToUnit(userId);
+        }
+
+        bool GAEventSampler::admit(std::string const& category, std::string const& eventId, double& sampleRate)
+        {
+            sampleRate = 1.0;
+
+            if (!_hasRules)
+            {
+                return true;
+            }
+
+            Rules const* rules = currentRules();
+            ActiveRule const* active = rules ? findRule(*rules, category, eventId) : nullptr;
+            if (!active)
+            {
+                return true;
+            }
+
+            if (!isSampledIn(active->rule, eventId))
+            {
+                ++_sampledOut;
+                return false;
+            }
+
+            if (!takeToken(*active))
+            {
+                ++_rateLimited;
+                return false;
+            }
+
+            sampleRate = active->rule.sampleRate;
+            return true;
+        }
+
+        int64_t GAEventSampler::getSampledOutCount() const
+        {
+            return _sampledOut;
+        }
+
+        int64_t GAEventSampler::getRateLimitedCount() const
+        {
+            return _rateLimited;
+        }
+
+        void GAEventSampler::activateRules()
+        {
+            std::vector<Rule> rules = _localRules;
+            for (Rule const& rule : _remoteRules)
+            {
+                replaceRule(rules, rule);
+            }
+
+            // the longest prefix first, a rule for a category before one for all of them
+            std::sort(rules.begin(), rules.end(),
+                [](Rule const& a, Rule const& b)
+                {
+                    if (a.eventIdPrefix.size() != b.eventIdPrefix.size())
+                    {
+                        return a.eventIdPrefix.size() > b.eventIdPrefix.size();
+                    }
+                    return a.category.size() > b.category.size();
+                });
+
+            std::shared_ptr<const Rules> previous = std::atomic_load(&_rules);
+            auto active = std::make_shared<Rules>();
+
+            for (Rule& rule : rules)
+            {
+                // one second worth of events by default
+                if (rule.maxEventsPerSecond > 0.0 && rule.burst < 1.0)
+                {
+                    rule.burst = std::max(1.0, rule.maxEventsPerSecond);
+                }
+
+                ActiveRule next;
+                if (rule.maxEventsPerSecond > 0.0)
+                {
+                    next.interval = std::max<int64_t>(1, static_cast<int64_t>(1e9 / rule.maxEventsPerSecond));
+                    next.tolerance = static_cast<int64_t>((rule.burst - 1.0) * static_cast<double>(next.interval));
+
+                    // a remote config refresh keeps the tokens of an unchanged limit, new buckets start full
+                    if (previous)
+                    {
+                        for (ActiveRule const& kept : *previous)
+                        {
+                            if (kept.bucket && kept.rule.category == rule.category && kept.rule.eventIdPrefix == rule.eventIdPrefix
+                                && kept.rule.maxEventsPerSecond == rule.maxEventsPerSecond && kept.rule.burst == rule.burst)
+                            {
+                                next.bucket = kept.bucket;
+                                break;
+                            }
+                        }
+                    }
+
+                    if (!next.bucket)
+                    {
+                        next.bucket = std::make_shared<Bucket>();
+                    }
+                }
+                next.rule = std::move(rule);
+
+                active->push_back(std::move(next));
+            }
+
+            _hasRules = !active->empty();
+            std::atomic_store(&_rules, std::shared_ptr<const Rules>(std::move(active)));
+            _rulesVersion.store(++rulesVersions, std::memory_order_release);
+        }
+
+        GAEventSampler::Rules const* GAEventSampler::currentRules() const
+        {
+            // the shared pointer is loaded again only after the rules changed, otherwise this is one atomic read
+            struct CachedRules
+            {
+                uint64_t version = 0;
+                std::shared_ptr<const Rules> rules;
+            };
+            thread_local CachedRules cached;
+
+            const uint64_t version = _rulesVersion.load(std::memory_order_acquire);
+            if (cached.version != version)
+            {
+                cached.rules = std::atomic_load(&_rules);
+                cached.version = version;
+            }
+
+            return cached.rules.get();
+        }
+
+        GAEventSampler::ActiveRule const* GAEventSampler::findRule(Rules const& rules, std::string const& category, std::string const& eventId)
+        {
+            for (ActiveRule const& active : rules)
+            {
+                if (!active.rule.category.empty() && active.rule.category != category)
+                {
+                    continue;
+                }
+
+                if (eventId.compare(0, active.rule.eventIdPrefix.size(), active.rule.eventIdPrefix) == 0)
+                {
+                    return &active;
+                }
+            }
+
+            return nullptr;
+        }
+
+        bool GAEventSampler::isSampledIn(Rule const& rule, std::string const& eventId) const
+        {
+            if (rule.sampleRate >= 1.0)
+            {
+                return true;
+            }
+
+            switch (rule.mode)
+            {
+                case SamplePerUser:
+                {
+                    // before the user id is known the events are sampled one by one, at the same rate
+                    const double userUnit = _userUnit;
+                    return (userUnit < 0.0 ? randomUnit() : userUnit) < rule.sampleRate;
+                }
+
+                case SamplePerEventId:
+                    return hashToUnit(eventId) < rule.sampleRate;
+
+                default:
+                    return randomUnit() < rule.sampleRate;
+            }
+        }
+
+        bool GAEventSampler::takeToken(ActiveRule const& active)
+        {
+            if (!active.bucket)
+            {
+                return true;
+            }
+
+            const int64_t now = steadyNanoseconds();
+            int64_t fullAt = active.bucket->fullAt.load(std::memory_order_relaxed);
+
+            while (true)
+            {
+                // refilled up to now, each kept event moves the time it is full again by one interval
+                const int64_t from = std::max(fullAt, now);
+                if (from - now > active.tolerance)
+                {
+                    return false;
+                }
+
+                if (active.bucket->fullAt.compare_exchange_weak(fullAt, from + active.interval, std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+        }
+
+        bool GAEventSampler::parseRule(json const& in, Rule& out)
+        {
+            if (!in.is_object())
+            {
+                return false;
+            }
+
+            std::string mode;
+            try
+            {
+                out.category = in.value("category", "");
+                out.eventIdPrefix = in.value("prefix", "");
+                out.sampleRate = in.value("rate", 1.0);
+                out.maxEventsPerSecond = in.value("max_per_second", 0.0);
+                out.burst = in.value("burst", 0.0);
+                mode = in.value("mode", "event");
+            }
+            catch (json::exception const&)
+            {
+                // a field of the wrong type
+                return false;
+            }
+
+            if (mode == "user")
+            {
+                out.mode = SamplePerUser;
+            }
+            else if (mode == "event_id")
+            {
+                out.mode = SamplePerEventId;
+            }
+            else if (mode == "event")
+            {
+                out.mode = SamplePerEvent;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (out.sampleRate < 0.0 || out.sampleRate > 1.0 || out.maxEventsPerSecond < 0.0 || out.burst < 0.0)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        void GAEventSampler::replaceRule(std::vector<Rule>& rules, Rule const& rule)
+        {
+            auto existing = std::find_if(rules.begin(), rules.end(),
+                [&rule](Rule const& r)
+                {
+                    return r.category == rule.category && r.eventIdPrefix == rule.eventIdPrefix;
+                });
+
+            if (existing != rules.end())
+            {
+                *existing = rule;
+            }
+            else
+            {
+                rules.push_back(rule);
+            }
+        }
+    }
+}
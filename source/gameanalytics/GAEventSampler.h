@@ -0,0 +1,111 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#pragma once
+
+#include "GACommon.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace gameanalytics
+{
+    namespace events
+    {
+        // keeps a share of the events of a category and event id prefix and caps how many of them are added per second,
+        // on the thread adding them before they are queued. Rules are set locally and can be replaced by the remote config
+        class GAEventSampler
+        {
+         public:
+
+            // custom field with the sample rate of a kept event, counts can be divided by it
+            static constexpr const char* SampleRateField = "ga_sample_rate";
+
+            // remote config with a json array of rules, they replace the local rules with the same category and prefix:
+            // [{"category": "design", "prefix": "hit:", "rate": 0.1, "mode": "user", "max_per_second": 50, "burst": 100}]
+            static constexpr const char* RemoteConfigKey = "ga_sampling";
+
+            struct Rule
+            {
+                // empty matches every category
+                std::string     category;
+                std::string     eventIdPrefix;
+                double          sampleRate = 1.0;
+                EGASamplingMode mode = SamplePerEvent;
+                // token bucket of the kept events, no limit if 0
+                double          maxEventsPerSecond = 0;
+                double          burst = 0;
+            };
+
+            // adds the rule or replaces the one with the same category and prefix
+            void setRule(Rule const& rule);
+
+            // the rules of the remote config, anything but an array (or a string holding one) removes them
+            void setRemoteRules(json const& rules);
+
+            // used by SamplePerUser, events are sampled one by one until it is set
+            void setUserId(std::string const& userId);
+
+            // lets callers skip building the event id
+            bool hasRules() const { return _hasRules; }
+
+            // false if the event is sampled out or over its rate. Otherwise sampleRate is the share of events kept by its rule
+            bool admit(std::string const& category, std::string const& eventId, double& sampleRate);
+
+            int64_t getSampledOutCount() const;
+            int64_t getRateLimitedCount() const;
+
+         private:
+
+            // token bucket kept as the time it is full again, taking a token is one compare and swap
+            struct Bucket
+            {
+                // steady clock nanoseconds, in the past while the bucket is full
+                std::atomic<int64_t> fullAt{0};
+            };
+
+            struct ActiveRule
+            {
+                Rule    rule;
+                // nanoseconds per token, and how far the bucket may be behind with one token left
+                int64_t interval = 0;
+                int64_t tolerance = 0;
+                // null without a rate limit, shared with the next rules while the limit is unchanged
+                std::shared_ptr<Bucket> bucket;
+            };
+
+            using Rules = std::vector<ActiveRule>;
+
+            // merges the local and the remote rules and publishes them, needs the mutex
+            void activateRules();
+            Rules const* currentRules() const;
+            static ActiveRule const* findRule(Rules const& rules, std::string const& category, std::string const& eventId);
+            bool isSampledIn(Rule const& rule, std::string const& eventId) const;
+            static bool takeToken(ActiveRule const& active);
+
+            static bool parseRule(json const& in, Rule& out);
+            static void replaceRule(std::vector<Rule>& rules, Rule const& rule);
+
+            // only for changing the rules, admit reads the published snapshot without it
+            std::mutex              _mutex;
+            std::vector<Rule>       _localRules;
+            std::vector<Rule>       _remoteRules;
+
+            // immutable once published, read and replaced with std::atomic_load and std::atomic_store
+            std::shared_ptr<const Rules> _rules;
+            std::atomic<uint64_t>   _rulesVersion{0};
+
+            // hash of the user id, negative until it is set
+            std::atomic<double>     _userUnit{-1.0};
+
+            // skips the snapshot while there are no rules
+            std::atomic<bool>       _hasRules{false};
+            std::atomic<int64_t>    _sampledOut{0};
+            std::atomic<int64_t>    _rateLimited{0};
+        };
+    }
+}
@@ -0,0 +1,110 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#pragma once
+
+#include "GACommon.h"
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+namespace gameanalytics
+{
+    namespace store
+    {
+        // appends the event's json object to out, with the annotation fields split off it put back in
+        inline void appendEvent(std::string& out, std::string_view event, std::string_view annotations)
+        {
+            if (annotations.empty() || event.size() < 2)
+            {
+                out += event;
+                return;
+            }
+
+            out += '{';
+            out += annotations;
+
+            // "{}" has no fields of its own
+            if (event.size() > 2)
+            {
+                out += ',';
+                out += event.substr(1);
+            }
+            else
+            {
+                out += '}';
+            }
+        }
+
+        inline std::string joinEvent(std::string_view annotations, std::string_view event)
+        {
+            std::string text;
+            text.reserve(annotations.size() + event.size() + 1);
+            appendEvent(text, event, annotations);
+
+            return text;
+        }
+
+        // an event as it is handed to the event store
+        struct GAStoredEvent
+        {
+            std::string category;
+            std::string sessionId;
+            std::string clientTs;
+            std::string event;
+
+            // with compact storage: the fields the event shares with the rest of the session, as a json object
+            // without its braces. They are not part of event then
+            std::string annotations;
+
+            std::string text() const
+            {
+                return joinEvent(annotations, event);
+            }
+        };
+
+        // where events wait until they are uploaded, only used from the ga thread.
+        // Claimed events belong to the request which claimed them until it is acked or nacked
+        class IEventStore
+        {
+         public:
+
+            // called with the json text of every claimed event, only valid during the call. Annotations are the fields
+            // split off the event by compact storage (see GAStoredEvent), empty if the event is complete
+            using EventCallback = std::function<void(std::string_view event, std::string_view annotations)>;
+
+            virtual ~IEventStore() = default;
+
+            virtual bool append(GAStoredEvent const& event) = 0;
+
+            // claims up to maxEvents new events for the request and passes them to onEvent, oldest first.
+            // An empty category claims events of any category. Returns the number of claimed events, -1 on errors
+            virtual int64_t claimBatch(std::string const& requestId, std::string const& category, std::size_t maxEvents, EventCallback const& onEvent) = 0;
+
+            // the request's events were delivered (or rejected by the collector), they are removed
+            virtual void ack(std::string const& requestId) = 0;
+
+            // the request failed, its events are claimed again by a later batch
+            virtual void nack(std::string const& requestId) = 0;
+
+            // hands the events of all claims back, e.g. the ones left over when the app was killed during an upload
+            virtual void nackAll() = 0;
+
+            // removes events until the store takes at most maxBytes, the least valuable and oldest first.
+            // Returns the number of removed events
+            virtual int64_t trim(int64_t maxBytes) = 0;
+
+            // gives the space of removed events back in small steps, meant for idle time. Returns true while there is more to do
+            virtual bool compact(std::chrono::milliseconds budget) = 0;
+
+            // makes the appended events durable
+            virtual void sync() = 0;
+
+            // events not acked yet
+            virtual int64_t size() = 0;
+            virtual int64_t sizeBytes() = 0;
+        };
+    }
+}
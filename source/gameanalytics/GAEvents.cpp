@@ -4,11 +4,14 @@
 //
 
 #include <vector>
+#include <algorithm>
 #include "GAEvents.h"
 #include "GAState.h"
 #include "GAUtilities.h"
 #include "GALogger.h"
 #include "GAStore.h"
+#include "GASqliteEventStore.h"
+#include "GALogEventStore.h"
 #include "GADevice.h"
 #include "GAThreading.h"
 #include "GAValidator.h"
@@ -57,6 +60,7 @@ namespace gameanalytics
                     }
                 );
             }
+
         }
  
         // USER EVENTS
@@ -116,6 +120,9 @@ namespace gameanalytics
             
             try
             {
+                // folded events belong to the session which is ending
+                flushAggregatedEvents();
+
                 // get session length in seconds
                 int64_t sessionLength  = state.calculateSessionLength<std::chrono::seconds>();
 
@@ -213,7 +220,7 @@ namespace gameanalytics
             
         }
 
-        void GAEvents::addResourceEvent(EGAResourceFlowType flowType, std::string const& currency, double amount, std::string const& itemType, std::string const& itemId, const json& fields, bool mergeFields)
+        void GAEvents::addResourceEvent(EGAResourceFlowType flowType, std::string const& currency, double amount, std::string const& itemType, std::string const& itemId, const json& fields, bool mergeFields, double sampleRate)
         {
             try
             {
@@ -251,7 +258,7 @@ namespace gameanalytics
                 // Add custom dimensions
                 getInstance().addDimensionsToEvent(eventDict);
 
-                json cleanedFields = state::GAState::getValidatedCustomFields(fields);
+                json cleanedFields = getValidatedCustomFields(fields, sampleRate);
                 getInstance().addCustomFieldsToEvent(eventDict, cleanedFields);
 
                 // Log
@@ -272,7 +279,7 @@ namespace gameanalytics
             
         }
 
-        void GAEvents::addProgressionEvent(EGAProgressionStatus progressionStatus, std::string const& progression01, std::string const& progression02, std::string const& progression03, int score, bool sendScore, const json& fields, bool mergeFields)
+        void GAEvents::addProgressionEvent(EGAProgressionStatus progressionStatus, std::string const& progression01, std::string const& progression02, std::string const& progression03, int score, bool sendScore, const json& fields, bool mergeFields, double sampleRate)
         {
             try
             {
@@ -347,7 +354,7 @@ namespace gameanalytics
                 // Add custom dimensions
                 getInstance().addDimensionsToEvent(eventDict);
 
-                json cleanedFields = state::GAState::getValidatedCustomFields(fields);
+                json cleanedFields = getValidatedCustomFields(fields, sampleRate);
 
                 getInstance().addCustomFieldsToEvent(eventDict, cleanedFields);
 
@@ -364,7 +371,7 @@ namespace gameanalytics
             }
         }
 
-        void GAEvents::addDesignEvent(std::string const& eventId, double value, bool sendValue, const json& fields, bool mergeFields)
+        void GAEvents::addDesignEvent(std::string const& eventId, double value, bool sendValue, const json& fields, bool mergeFields, double sampleRate)
         {
             try
             {
@@ -393,7 +400,7 @@ namespace gameanalytics
                     eventData["value"] = value;
                 }
 
-                json cleanedFields = state::GAState::getValidatedCustomFields(fields);
+                json cleanedFields = getValidatedCustomFields(fields, sampleRate);
 
                 GAEvents::getInstance().addCustomFieldsToEvent(eventData, cleanedFields);
 
@@ -404,6 +411,13 @@ namespace gameanalytics
                 logging::GALogger::i("Add DESIGN event: {eventId:%s, value:%f, fields:%s}", 
                     eventId.c_str(), value, cleanedFields.dump(JSON_PRINT_INDENT).c_str());
 
+                // Stored once its window is over
+                if (getInstance()._isAggregating)
+                {
+                    getInstance().aggregateDesignEvent(eventData);
+                    return;
+                }
+
                 // Send to store
                 getInstance().addEventToStore(eventData);
             }
@@ -417,7 +431,7 @@ namespace gameanalytics
             }
         }
 
-        void GAEvents::addErrorEvent(EGAErrorSeverity severity, std::string const& message, std::string const& function, int32_t line, const json& fields, bool mergeFields, bool skipAddingFields)
+        void GAEvents::addErrorEvent(EGAErrorSeverity severity, std::string const& message, std::string const& function, int32_t line, const json& fields, bool mergeFields, bool skipAddingFields, double sampleRate)
         {
             try
             {
@@ -454,7 +468,7 @@ namespace gameanalytics
                 json cleanedFields;
                 if(!skipAddingFields)
                 {
-                    cleanedFields = state::GAState::getValidatedCustomFields(fields);
+                    cleanedFields = getValidatedCustomFields(fields, sampleRate);
                     getInstance().addCustomFieldsToEvent(eventData, cleanedFields);
                 }
 
@@ -476,14 +490,45 @@ namespace gameanalytics
 
         void GAEvents::processEventQueue()
         {
+            // the connection type is refreshed once per interval, events are annotated with the cached value
+            checkConnection();
+
             processEvents("", true);
 
+            // give the space of removed events back a little at a time
+            eventStore().compact(CompactionBudget);
+            storeSizeBytes();
+
             if (!getInstance().keepRunning)
             {
                 getInstance().isRunning = false;
             }
         }
 
+        void GAEvents::checkConnection()
+        {
+            const bool wasOffline = device::GADevice::getConnectionType() == CONNECTION_OFFLINE;
+            if (!device::GADevice::updateConnectionType() || !wasOffline || !keepRunning)
+            {
+                return;
+            }
+
+            // a request holds at most MaxEventCount events, the backlog stored while offline gets a second one
+            // queued behind this interval's upload instead of waiting for the next interval
+            if (device::GADevice::getConnectionType() != CONNECTION_OFFLINE)
+            {
+                logging::GALogger::i("Network connection is back, sending stored events");
+                threading::GAThreading::performTaskOnGAThread(
+                    []()
+                    {
+                        if (getInstance().keepRunning)
+                        {
+                            processEvents("", false);
+                        }
+                    });
+            }
+        }
+
         void GAEvents::processEvents(std::string const& category, bool performCleanup)
         {
             if(!state::GAState::isEventSubmissionEnabled())
@@ -494,13 +539,6 @@ namespace gameanalytics
             // Request identifier
             std::string requestIdentifier = utilities::GAUtilities::generateUUID();
 
-            std::string andCategory = category.empty() ? "" : utilities::printString(" AND category='%s' ", category.c_str());
-
-            std::string selectSql  = utilities::printString("SELECT event FROM ga_events WHERE status = 'new' %s;", andCategory.c_str());
-            std::string updateSql  = utilities::printString("UPDATE ga_events SET status = '%s' WHERE status = 'new' %s;", requestIdentifier.c_str(), andCategory.c_str());
-            std::string deleteSql  = utilities::printString("DELETE FROM ga_events WHERE status = '%s'", requestIdentifier.c_str());
-            std::string putbackSql = utilities::printString("UPDATE ga_events SET status = 'new' WHERE status = '%s';", requestIdentifier.c_str());
-
             // Cleanup
             if (performCleanup)
             {
@@ -508,85 +546,464 @@ namespace gameanalytics
                 getInstance().fixMissingSessionEndEvents();
             }
 
-            // Get events to process
-            json events;
-            store::GAStore::executeQuerySync(selectSql, events);
+            // Claim a batch and put its events into the request body as they are stored
+            std::string payload = "[";
+            const int64_t claimed = getInstance().eventStore().claimBatch(requestIdentifier, category, MaxEventCount,
+                [&payload](std::string_view event, std::string_view annotations)
+                {
+                    addEventToPayload(payload, event, annotations);
+                });
+            payload += ']';
+
+            if (claimed < 0)
+            {
+                return;
+            }
+
+            // nothing stored, send what is buffered in memory
+            if (claimed == 0 && category.empty() && !getInstance()._bufferedEvents.empty())
+            {
+                getInstance().sendBufferedEvents(requestIdentifier);
+                return;
+            }
 
-            // Check for errors or empty
-            if (events.is_null() || events.size() == 0)
+            // Check for empty
+            if (claimed == 0)
             {
                 logging::GALogger::i("Event queue: No events to send");
                 getInstance().updateSessionTime();
                 return;
             }
 
-            // Check number of events and take some action if there are too many?
-            if (events.size() > MaxEventCount)
-            {
-                // Make a limit request
-                selectSql = utilities::printString("SELECT client_ts FROM ga_events WHERE status = 'new' %s ORDER BY client_ts ASC LIMIT 0,%d;", andCategory.c_str(), GAEvents::MaxEventCount);
-                store::GAStore::executeQuerySync(selectSql, events);
-                if (events.is_null())
+            const std::size_t eventCount = static_cast<std::size_t>(claimed);
+
+            // Log
+            logging::GALogger::i("Event queue: Sending %d events.", eventCount);
+
+            // hand the batch over to the upload lane, the ga thread keeps ingesting events meanwhile
+            getInstance()._requestsInFlight.push_back(requestIdentifier);
+
+            threading::GAThreading::performTaskOnIOThread(
+                [requestIdentifier, eventCount, payload = std::move(payload)]()
                 {
-                    return;
+                    getInstance().sendEvents(requestIdentifier, eventCount, payload);
                 }
+            );
+        }
+
+        void GAEvents::addEventToPayload(std::string& payload, std::string_view event, std::string_view annotations)
+        {
+            // a row which isn't a json object would break the whole batch
+            if (event.size() < 2 || event.front() != '{' || event.back() != '}')
+            {
+                logging::GALogger::d("processEvents -- skipping malformed event: %s", std::string(event).c_str());
+                return;
+            }
+
+            if (payload.size() > 1)
+            {
+                payload += ',';
+            }
+
+            store::appendEvent(payload, event, annotations);
+        }
 
-                // Get last timestamp
-                const json& lastItem = events.back();
-                const std::string lastTimestamp = lastItem["client_ts"].get<std::string>();
+        void GAEvents::sendBufferedEvents(std::string const& requestIdentifier)
+        {
+            const std::size_t eventCount = std::min(_bufferedEvents.size(), static_cast<std::size_t>(MaxEventCount));
+
+            std::vector<BufferedEvent> batch;
+            batch.reserve(eventCount);
+
+            std::string payload = "[";
+            for (std::size_t i = 0; i < eventCount; ++i)
+            {
+                BufferedEvent const& e = _bufferedEvents.front();
+                addEventToPayload(payload, e.event, e.annotations);
+
+                batch.push_back(std::move(_bufferedEvents.front()));
+                _bufferedEvents.pop_front();
+            }
+
+            payload += ']';
+
+            logging::GALogger::i("Event queue: Sending %d buffered events.", eventCount);
+
+            // kept until the upload is done, they are stored if it fails
+            _bufferedInFlight.emplace(requestIdentifier, std::move(batch));
+            _requestsInFlight.push_back(requestIdentifier);
 
-                // Select again
-                selectSql = utilities::printString("SELECT event FROM ga_events WHERE status = 'new' %s AND client_ts<='%s';", andCategory.c_str(), lastTimestamp.c_str());
-                store::GAStore::executeQuerySync(selectSql, events);
-                if (events.is_null())
+            threading::GAThreading::performTaskOnIOThread(
+                [requestIdentifier, eventCount, payload = std::move(payload)]()
                 {
-                    return;
+                    getInstance().sendEvents(requestIdentifier, eventCount, payload);
                 }
+            );
+        }
+
+        void GAEvents::storeEvents(std::vector<BufferedEvent> const& events)
+        {
+            store::IEventStore& store = eventStore();
 
-                // Update sql
-                updateSql = utilities::printString("UPDATE ga_events SET status='%s' WHERE status='new' %s AND client_ts<='%s';", requestIdentifier.c_str(), andCategory.c_str(), lastTimestamp.c_str());
+            // with group commit these end up in a single transaction
+            for (BufferedEvent const& e : events)
+            {
+                store.append(e);
             }
+        }
 
-            // Log
-            logging::GALogger::i("Event queue: Sending %d events.", events.size());
+        void GAEvents::configureWriteBehind(bool enabled, std::size_t maxEvents, std::chrono::milliseconds spillInterval)
+        {
+            GAEvents& instance = getInstance();
 
-            // Set status of events to 'sending' (also check for error)
-            json updateResult;
-            store::GAStore::executeQuerySync(updateSql, updateResult);
-            if (updateResult.is_null())
+            if (instance._spillTimer != threading::GAThreading::InvalidTimerId)
             {
+                threading::GAThreading::cancelTimer(instance._spillTimer);
+                instance._spillTimer = threading::GAThreading::InvalidTimerId;
+            }
+
+            if (!enabled)
+            {
+                spillBufferedEvents();
+            }
+
+            instance._isWriteBehind     = enabled;
+            instance._maxBufferedEvents = std::max<std::size_t>(maxEvents, 1);
+
+            if (enabled)
+            {
+                instance._spillTimer = threading::GAThreading::scheduleTimer(spillInterval, []() { spillBufferedEvents(); });
+            }
+        }
+
+        void GAEvents::spillBufferedEvents()
+        {
+            GAEvents& instance = getInstance();
+
+            if (!instance._bufferedEvents.empty())
+            {
+                std::vector<BufferedEvent> events(std::make_move_iterator(instance._bufferedEvents.begin()), std::make_move_iterator(instance._bufferedEvents.end()));
+                instance._bufferedEvents.clear();
+
+                logging::GALogger::d("Event queue: Storing %d buffered events.", events.size());
+                instance.storeEvents(events);
+            }
+
+            // skipped for the buffered events
+            if (instance._isSessionTimeDirty)
+            {
+                instance._isSessionTimeDirty = false;
+                instance.updateSessionTime();
+            }
+        }
+
+        void GAEvents::configureDesignEventAggregation(bool enabled, std::chrono::milliseconds window)
+        {
+            GAEvents& instance = getInstance();
+
+            if (instance._aggregationTimer != threading::GAThreading::InvalidTimerId)
+            {
+                threading::GAThreading::cancelTimer(instance._aggregationTimer);
+                instance._aggregationTimer = threading::GAThreading::InvalidTimerId;
+            }
+
+            if (!enabled)
+            {
+                flushAggregatedEvents();
+            }
+
+            instance._isAggregating = enabled;
+
+            if (enabled)
+            {
+                instance._aggregationTimer = threading::GAThreading::scheduleTimer(window, []() { flushAggregatedEvents(); });
+            }
+        }
+
+        void GAEvents::aggregateDesignEvent(json& eventData)
+        {
+            const bool hasValue = eventData.contains("value");
+            const double value = hasValue ? eventData["value"].get<double>() : 0.0;
+
+            // everything but the value has to match, the dump is sorted by key
+            json keyData = eventData;
+            keyData.erase("value");
+            const std::string key = (hasValue ? "v" : "n") + keyData.dump();
+
+            auto existing = _aggregatedEvents.find(key);
+            if (existing != _aggregatedEvents.end())
+            {
+                AggregatedEvent& aggregated = existing->second;
+                ++aggregated.count;
+                aggregated.sum += value;
+                aggregated.min = std::min(aggregated.min, value);
+                aggregated.max = std::max(aggregated.max, value);
                 return;
             }
 
-            // Create payload data from events
-            json payloadArray;
-            for (auto& node : events)
+            if (_aggregatedEvents.size() >= MaxAggregatedEvents)
             {
-                const std::string eventDict = utilities::getOptionalValue<std::string>(node, "event");
-                if (!eventDict.empty())
+                flushAggregatedEvents();
+            }
+
+            AggregatedEvent aggregated;
+            aggregated.eventData = std::move(eventData);
+            aggregated.hasValue = hasValue;
+            aggregated.count = 1;
+            aggregated.sum = aggregated.min = aggregated.max = value;
+
+            // the time of the first event, not of the flush
+            aggregated.eventData["client_ts"] = utilities::GAUtilities::timeIntervalSince1970();
+
+            _aggregatedEvents.emplace(key, std::move(aggregated));
+        }
+
+        void GAEvents::flushAggregatedEvents()
+        {
+            GAEvents& instance = getInstance();
+            if (instance._aggregatedEvents.empty())
+            {
+                return;
+            }
+
+            std::unordered_map<std::string, AggregatedEvent> aggregatedEvents;
+            aggregatedEvents.swap(instance._aggregatedEvents);
+
+            logging::GALogger::d("Event queue: Storing %zu aggregated design events.", aggregatedEvents.size());
+
+            for (auto& entry : aggregatedEvents)
+            {
+                AggregatedEvent& aggregated = entry.second;
+                json& eventData = aggregated.eventData;
+
+                // a single event is stored as it was added
+                if (aggregated.count > 1)
                 {
-                    try
+                    json& fields = eventData["custom_fields"];
+
+                    // the caller's fields last in key order make room for count, min and max, the sample rate is kept
+                    const std::size_t maxFields = MAX_CUSTOM_FIELDS_COUNT - (aggregated.hasValue ? AggregateFieldCount : AggregateCountOnlyFieldCount);
+                    std::string dropped;
+                    while (fields.size() > maxFields)
                     {
-                        json d = json::parse(eventDict);
-                        if(d.contains("client_ts") && d["client_ts"].is_number_integer())
+                        auto last = std::prev(fields.end());
+                        if (last.key() == GAEventSampler::SampleRateField)
                         {
-                            if (!validators::GAValidator::validateClientTs(d["client_ts"].get<int64_t>()))
-                            {
-                                d.erase("client_ts");
-                            }
+                            last = std::prev(last);
                         }
 
-                        payloadArray.push_back(std::move(d));
+                        dropped += (dropped.empty() ? "" : ", ") + last.key();
+                        fields.erase(last);
                     }
-                    catch(const json::exception& e)
+
+                    if (!dropped.empty())
                     {
-                        logging::GALogger::d("processEvents -- JSON error: %s", e.what());
-                        logging::GALogger::d(eventDict.c_str());
+                        logging::GALogger::w("Aggregated design event %s: dropped custom fields %s to make room for the aggregate fields",
+                            eventData.value("event_id", std::string()).c_str(), dropped.c_str());
+                    }
+
+                    fields[AggregateCountField] = aggregated.count;
+
+                    if (aggregated.hasValue)
+                    {
+                        eventData["value"] = aggregated.sum;
+                        fields[AggregateMinField] = aggregated.min;
+                        fields[AggregateMaxField] = aggregated.max;
                     }
                 }
+
+                instance.addEventToStore(eventData);
             }
+        }
 
-            // send events
+        void GAEvents::persistEvents()
+        {
+            flushAggregatedEvents();
+            spillBufferedEvents();
+            getInstance().eventStore().sync();
+
+            // session and state rows
+            store::GAStore::commitPendingWrites();
+        }
+
+        void GAEvents::setEventStoreType(EGAEventStoreType type)
+        {
+            getInstance()._eventStoreType = type;
+        }
+
+        store::IEventStore& GAEvents::eventStore()
+        {
+            if (!_eventStore)
+            {
+                if (_eventStoreType == EventStoreLog)
+                {
+                    _eventStore = std::make_unique<store::GALogEventStore>(store::GAStore::getStorageDirectory() / "events");
+                }
+                else
+                {
+                    _eventStore = std::make_unique<store::GASqliteEventStore>();
+                }
+
+                makeRoomInStore();
+            }
+
+            return *_eventStore;
+        }
+
+        bool GAEvents::makeRoomInStore()
+        {
+            const int64_t budget = _storeBudgetBytes;
+
+            // trimmed below the budget so this doesn't run again for every event
+            _eventStore->trim(budget - budget / 6);
+            return storeSizeBytes() <= budget;
+        }
+
+        int64_t GAEvents::storeSizeBytes()
+        {
+            const int64_t bytes = eventStore().sizeBytes();
+            _storeSizeBytes = bytes;
+
+            return bytes;
+        }
+
+        void GAEvents::setCompactStorage(bool enabled)
+        {
+            getInstance()._isCompactStorage = enabled;
+        }
+
+        void GAEvents::splitAnnotations(json& event, json const& eventData, BufferedEvent& out)
+        {
+            json annotations = json::object();
+
+            for (auto it = event.begin(); it != event.end();)
+            {
+                // unique per event, or set by the event itself
+                if (it.key() == "client_ts" || it.key() == "event_uuid" || eventData.contains(it.key()))
+                {
+                    ++it;
+                    continue;
+                }
+
+                annotations[it.key()] = std::move(it.value());
+                it = event.erase(it);
+            }
+
+            // the same for every event until an annotation changes, e.g. a new session or connection type
+            out.annotations = annotations.dump();
+            out.annotations = out.annotations.substr(1, out.annotations.size() - 2);
+            out.event = event.dump();
+        }
+
+        void GAEvents::buildStoredEvent(json const& eventData, BufferedEvent& out)
+        {
+            json const& staticAnnotations = state::GAState::getStaticAnnotations();
+
+            // fields set by the event itself take the place of the annotations, that needs the merge
+            bool overridesAnnotations = false;
+            for (auto it = eventData.begin(); it != eventData.end() && !overridesAnnotations; ++it)
+            {
+                overridesAnnotations = staticAnnotations.contains(it.key());
+            }
+
+            json ev;
+            if (overridesAnnotations)
+            {
+                state::GAState::getEventAnnotations(ev);
+                ev.merge_patch(eventData);
+            }
+            else
+            {
+                // only the per event annotations are added, the rest is joined in as the cached text
+                ev = eventData;
+                json variable;
+                state::GAState::addVariableAnnotations(variable);
+                for (auto& field : variable.items())
+                {
+                    if (!ev.contains(field.key()))
+                    {
+                        ev[field.key()] = std::move(field.value());
+                    }
+                }
+            }
+
+            const int64_t clientTs = ev["client_ts"].get<int64_t>();
+            out.category  = ev["category"].get<std::string>();
+            out.sessionId = overridesAnnotations ? ev["session_id"].get<std::string>() : staticAnnotations["session_id"].get<std::string>();
+            out.clientTs  = std::to_string(clientTs);
+
+            // checked once here, batches are sent as the events were stored
+            if (!validators::GAValidator::validateClientTs(clientTs))
+            {
+                ev.erase("client_ts");
+            }
+
+            if (overridesAnnotations)
+            {
+                if (_isCompactStorage)
+                {
+                    splitAnnotations(ev, eventData, out);
+                }
+                else
+                {
+                    out.event = ev.dump();
+                }
+            }
+            else if (_isCompactStorage)
+            {
+                // the cached text is the fragment shared with the rest of the session
+                out.annotations = state::GAState::getStaticAnnotationsText();
+                out.event = ev.dump();
+            }
+            else
+            {
+                out.event = store::joinEvent(state::GAState::getStaticAnnotationsText(), ev.dump());
+            }
+        }
+
+        GAEventSampler& GAEvents::sampler()
+        {
+            return getInstance()._sampler;
+        }
+
+        int64_t GAEvents::getStoreSizeBytes()
+        {
+            return getInstance()._storeSizeBytes;
+        }
+
+        void GAEvents::setStoreBudget(int64_t maxBytes)
+        {
+            getInstance()._storeBudgetBytes = maxBytes;
+        }
+
+        void GAEvents::uploadEvents(std::function<void(int64_t, int64_t)> onDone)
+        {
+            const int64_t before = getInstance().getStoredEventCount();
+
+            processEvents("", false);
+
+            // the io thread runs blocks in order, so this one comes after the upload queued above (and any earlier one),
+            // and its result is posted back to the ga thread before ours
+            threading::GAThreading::performTaskOnIOThread(
+                [before, onDone = std::move(onDone)]()
+                {
+                    threading::GAThreading::performTaskOnGAThread(
+                        [before, onDone]()
+                        {
+                            onDone(before, getInstance().getStoredEventCount());
+                        }
+                    );
+                }
+            );
+        }
+
+        int64_t GAEvents::getStoredEventCount()
+        {
+            return eventStore().size();
+        }
+
+        void GAEvents::sendEvents(std::string const& requestIdentifier, std::size_t eventCount, std::string const& payload)
+        {
             json dataDict;
             http::EGAHTTPApiResponse responseEnum;
             http::GAHTTPApi& http = http::GAHTTPApi::getInstance();
@@ -596,7 +1013,7 @@ namespace gameanalytics
 
             try
             {
-                pair = http->sendEventsInArray(payloadArray).get();
+                pair = http->sendEventsInArray(payload).get();
             }
             catch(Platform::COMException^ e)
             {
@@ -618,15 +1035,52 @@ namespace gameanalytics
                 }
             }
 #else
-            responseEnum = http.sendEventsInArray(dataDict, payloadArray);
+            responseEnum = http.sendEventsInArray(dataDict, payload);
 #endif
 
+            // the store is only touched from the ga thread
+            threading::GAThreading::performTaskOnGAThread(
+                [requestIdentifier, eventCount, responseEnum, data = std::move(dataDict)]()
+                {
+                    getInstance().onEventsSent(requestIdentifier, eventCount, responseEnum, data);
+                }
+            );
+        }
+
+        void GAEvents::onEventsSent(std::string const& requestIdentifier, std::size_t eventCount, http::EGAHTTPApiResponse responseEnum, const json& dataDict)
+        {
+            _requestsInFlight.erase(std::remove(_requestsInFlight.begin(), _requestsInFlight.end(), requestIdentifier), _requestsInFlight.end());
+
+            // batches sent from the write-behind buffer were never stored, there is nothing to delete
+            auto buffered = _bufferedInFlight.find(requestIdentifier);
+            if (buffered != _bufferedInFlight.end())
+            {
+                std::vector<BufferedEvent> events = std::move(buffered->second);
+                _bufferedInFlight.erase(buffered);
+
+                if (responseEnum == http::NoResponse)
+                {
+                    logging::GALogger::w("Event queue: Failed to send events to collector - Retrying next time");
+                    storeEvents(events);
+                }
+                else if (responseEnum == http::Ok)
+                {
+                    logging::GALogger::i("Event queue: %d events sent.", eventCount);
+                }
+                else
+                {
+                    logging::GALogger::w("Event queue: Failed to send events.");
+                }
+
+                return;
+            }
+
             if (responseEnum == http::Ok)
             {
                 // Delete events
-                store::GAStore::executeQuerySync(deleteSql);
+                eventStore().ack(requestIdentifier);
 
-                logging::GALogger::i("Event queue: %d events sent.", events.size());
+                logging::GALogger::i("Event queue: %d events sent.", eventCount);
             }
             else
             {
@@ -634,21 +1088,21 @@ namespace gameanalytics
                 if (responseEnum == http::NoResponse)
                 {
                     logging::GALogger::w("Event queue: Failed to send events to collector - Retrying next time");
-                    store::GAStore::executeQuerySync(putbackSql);
+                    eventStore().nack(requestIdentifier);
                     // Delete events (When getting some anwser back always assume events are processed)
                 }
                 else
                 {
                     if (responseEnum == http::BadRequest && dataDict.is_array())
                     {
-                        logging::GALogger::w("Event queue: %d events sent. %d events failed GA server validation.", events.size(), dataDict.size());
+                        logging::GALogger::w("Event queue: %d events sent. %d events failed GA server validation.", eventCount, dataDict.size());
                     }
                     else
                     {
                         logging::GALogger::w("Event queue: Failed to send events.");
                     }
 
-                    store::GAStore::executeQuerySync(deleteSql);
+                    eventStore().ack(requestIdentifier);
                 }
             }
         }
@@ -690,7 +1144,14 @@ namespace gameanalytics
 
         void GAEvents::cleanupEvents()
         {
-            store::GAStore::executeQuerySync("UPDATE ga_events SET status = 'new';");
+            // events claimed by an upload which is still in flight must not be sent twice
+            if(!_requestsInFlight.empty())
+            {
+                logging::GALogger::d("Event queue: %d request(s) in flight, skipping cleanup.", _requestsInFlight.size());
+                return;
+            }
+
+            eventStore().nackAll();
         }
 
         void GAEvents::fixMissingSessionEndEvents()
@@ -782,9 +1243,9 @@ namespace gameanalytics
 
             try
             {
-                // Check db size limits (10mb)
-                // If database is too large block all except user, session and business
-                if (store::GAStore::isDbTooLargeForEvents() && !utilities::GAUtilities::stringMatch(eventData["category"].get<std::string>(), "^(user|session_end|business)$"))
+                // Check the store's budget, low value events are evicted first to make room
+                // If that is not enough block all except user, session and business
+                if (storeSizeBytes() > _storeBudgetBytes && !makeRoomInStore() && !utilities::GAUtilities::stringMatch(eventData["category"].get<std::string>(), "^(user|session_end|business)$"))
                 {
                     logging::GALogger::w("Database too large. Event has been blocked.");
                     http::GAHTTPApi& httpInstance = http::GAHTTPApi::getInstance();
@@ -792,30 +1253,33 @@ namespace gameanalytics
                     return;
                 }
 
-                // Get default annotations
-                json ev;
-                state::GAState::getEventAnnotations(ev);
-                
-                logging::GALogger::i(ev.dump().c_str());
-                
-                ev.merge_patch(eventData);
-
-                const std::string jsonString = ev.dump();
+                BufferedEvent stored;
+                buildStoredEvent(eventData, stored);
+                std::string const& category = stored.category;
 
                 // output if VERBOSE LOG enabled
-                logging::GALogger::v("Event added to queue: %s", jsonString.c_str());
+                logging::GALogger::v("Event added to queue: %s", stored.annotations.empty() ? stored.event.c_str() : stored.text().c_str());
 
-                // Add to store
-                std::string const clientTS = std::to_string(ev["client_ts"].get<int64_t>());
-                StringVector parameters = { "new", ev["category"].get<std::string>(), ev["session_id"].get<std::string>(), clientTS, jsonString };
-                constexpr const char* sql = "INSERT INTO ga_events (status, category, session_id, client_ts, event) VALUES(?, ?, ?, ?, ?);";
+                // session start and end are always stored right away, the session bookkeeping relies on them
+                if (_isWriteBehind && category != GAEvents::CategorySessionStart && category != GAEvents::CategorySessionEnd)
+                {
+                    _bufferedEvents.push_back(std::move(stored));
+                    _isSessionTimeDirty = true;
 
-                store::GAStore::executeQuerySync(sql, parameters);
+                    if (_bufferedEvents.size() >= _maxBufferedEvents)
+                    {
+                        spillBufferedEvents();
+                    }
+
+                    return;
+                }
+
+                eventStore().append(stored);
 
                 // Add to session store if not last
                 if (eventData["category"].get<std::string>() == GAEvents::CategorySessionEnd)
                 {
-                    StringVector params = { ev["session_id"].get<std::string>() };
+                    StringVector params = { stored.sessionId };
                     store::GAStore::executeQuerySync("DELETE FROM ga_session WHERE session_id = ?;", params);
                 }
                 else
@@ -858,6 +1322,20 @@ namespace gameanalytics
             }
         }
 
+        json GAEvents::getValidatedCustomFields(const json& fields, double sampleRate, int reservedCount)
+        {
+            // events kept by a sampling rule carry its rate, so their counts can be scaled back up
+            const bool isSampled = sampleRate < 1.0;
+
+            json cleanedFields = state::GAState::getValidatedCustomFields(fields, MAX_CUSTOM_FIELDS_COUNT - reservedCount - (isSampled ? 1 : 0));
+            if (isSampled)
+            {
+                cleanedFields[GAEventSampler::SampleRateField] = sampleRate;
+            }
+
+            return cleanedFields;
+        }
+
         std::string GAEvents::progressionStatusString(EGAProgressionStatus progressionStatus)
         {
             switch (progressionStatus) 
@@ -987,6 +1465,12 @@ namespace gameanalytics
                 healthTracker->addHealthAnnotations(eventDict);
                 healthTracker->addPerformanceData(eventDict);
 
+                if(getInstance().enableSdkStats)
+                {
+                    eventDict["sdk_stats"] = threading::GAThreading::getStats();
+                    eventDict["sdk_stats"]["store_size_bytes"] = getStoreSizeBytes();
+                }
+
                 // Add custom dimensions
                 getInstance().addDimensionsToEvent(eventDict);
 
@@ -6,6 +6,13 @@
 #pragma once
 
 #include "GACommon.h"
+#include "GAHTTPApi.h"
+#include "GAThreading.h"
+#include "GAEventStore.h"
+#include "GAEventSampler.h"
+#include <deque>
+#include <unordered_map>
+#include <string_view>
 
 namespace gameanalytics
 {
@@ -23,10 +30,11 @@ namespace gameanalytics
             static void addSessionStartEvent();
             static void addSessionEndEvent();
             static void addBusinessEvent(std::string const& currency, int amount, std::string const& itemType, std::string const& itemId, std::string const& cartType, const json& fields, bool mergeFields);
-            static void addResourceEvent(EGAResourceFlowType flowType, std::string const& currency, double amount, std::string const& itemType, std::string const& itemId, const json& fields, bool mergeFields);
-            static void addProgressionEvent(EGAProgressionStatus progressionStatus, std::string const& progression01, std::string const& progression02, std::string const& progression03, int score, bool sendScore, const json& fields, bool mergeFields);
-            static void addDesignEvent(std::string const& eventId, double value, bool sendValue, const json& fields, bool mergeFields);
-            static void addErrorEvent(EGAErrorSeverity severity, std::string const& message, std::string const& function, int32_t line, const json& fields, bool mergeFields, bool skipAddingFields = false);
+            // sampleRate is the share of events kept by the sampling rule of the event, added as a custom field below 1
+            static void addResourceEvent(EGAResourceFlowType flowType, std::string const& currency, double amount, std::string const& itemType, std::string const& itemId, const json& fields, bool mergeFields, double sampleRate = 1.0);
+            static void addProgressionEvent(EGAProgressionStatus progressionStatus, std::string const& progression01, std::string const& progression02, std::string const& progression03, int score, bool sendScore, const json& fields, bool mergeFields, double sampleRate = 1.0);
+            static void addDesignEvent(std::string const& eventId, double value, bool sendValue, const json& fields, bool mergeFields, double sampleRate = 1.0);
+            static void addErrorEvent(EGAErrorSeverity severity, std::string const& message, std::string const& function, int32_t line, const json& fields, bool mergeFields, bool skipAddingFields = false, double sampleRate = 1.0);
 
             static void addSDKInitEvent();
             static void addHealthEvent();
@@ -37,10 +45,51 @@ namespace gameanalytics
 
             static void processEvents(std::string const& category, bool performCleanUp);
 
-            bool enableSDKInitEvent{false};
-            bool enableHealthEvent{false};
+            // sends all new events and calls onDone on the ga thread with the number of stored events before and after,
+            // once every upload started so far has finished. Needs to be called on the ga thread
+            static void uploadEvents(std::function<void(int64_t before, int64_t after)> onDone);
 
-        private:
+            // opt-in: events are kept in memory and uploaded from there, they are only written to the store on a timer,
+            // once maxEvents are buffered, when an upload fails and on suspend/quit. Needs to be called on the ga thread
+            static void configureWriteBehind(bool enabled, std::size_t maxEvents, std::chrono::milliseconds spillInterval);
+
+            // writes the buffered events to the store, needs to be called on the ga thread
+            static void spillBufferedEvents();
+
+            // spills the buffered events and makes the stored ones durable, needs to be called on the ga thread
+            static void persistEvents();
+
+            // backend the events are stored in until they are sent, has to be set before initialize
+            static void setEventStoreType(EGAEventStoreType type);
+
+            // bytes the stored events may take. Past it the least valuable events are evicted down to 5/6 of the budget,
+            // if that is not enough only session and business events are stored
+            static void setStoreBudget(int64_t maxBytes);
+
+            // size of the event store as of the last check on the ga thread, safe to call from any thread
+            static int64_t getStoreSizeBytes();
+
+            // stores the annotation fields events share (device, sdk, user, session, ...) once instead of in every event
+            static void setCompactStorage(bool enabled);
+
+            // opt-in: design events with the same event id, value presence, custom fields and dimensions are folded into one
+            // event per window. It carries the sum as value and count, min and max as custom fields. If there are too many,
+            // the caller's custom fields last in alphabetical order (the order of the sorted json keys) are dropped to make
+            // room for them, ga_sample_rate is kept. Needs to be called on the ga thread
+            static void configureDesignEventAggregation(bool enabled, std::chrono::milliseconds window);
+
+            // stores the folded design events, needs to be called on the ga thread
+            static void flushAggregatedEvents();
+
+            static constexpr const char* AggregateCountField = "ga_count";
+            static constexpr const char* AggregateMinField   = "ga_min";
+            static constexpr const char* AggregateMaxField   = "ga_max";
+            // custom fields added to a folded event with a value, and to one without (only the count)
+            static constexpr int         AggregateFieldCount = 3;
+            static constexpr int         AggregateCountOnlyFieldCount = 1;
+
+            // sampling and rate limits of the events added through the public api, safe to use from any thread
+            static GAEventSampler& sampler();
 
             static constexpr const char* CategorySessionStart           = "user";
             static constexpr const char* CategorySessionEnd             = "session_end";
@@ -51,25 +100,108 @@ namespace gameanalytics
             static constexpr const char* CategoryError                  = "error";
             static constexpr const char* CategorySDKInit                = "sdk_init";
             static constexpr const char* CategoryHealth                 = "health";
+
+            bool enableSDKInitEvent{false};
+            bool enableHealthEvent{false};
+            bool enableSdkStats{false};
+
+        private:
+
             static constexpr int         MaxEventCount                  = 500;
 
             static constexpr std::chrono::milliseconds PROCESS_EVENTS_INTERVAL{8000};
 
+            static constexpr int64_t     DefaultStoreBudgetBytes        = 6291456;
+
+            // spent on giving back the space of removed events each time the queue is processed
+            static constexpr std::chrono::milliseconds CompactionBudget{5};
+
+            // distinct design events folded at once, more flush the window early
+            static constexpr std::size_t MaxAggregatedEvents = 1000;
+
+            using BufferedEvent = store::GAStoredEvent;
+
             GAEvents();
             ~GAEvents();
             GAEvents(const GAEvents&) = delete;
             GAEvents& operator=(const GAEvents&) = delete;
 
             void processEventQueue();
+            // refreshes the cached connection type once per interval, queues an extra upload when the network comes back
+            void checkConnection();
             void cleanupEvents();
             void fixMissingSessionEndEvents();
             void addEventToStore(json& eventData);
+            void aggregateDesignEvent(json& eventData);
             void addDimensionsToEvent(json& eventData);
             void addCustomFieldsToEvent(json& eventData, json& fields);
+
+            // validates the fields with a slot kept free for the sample rate, which is added afterwards, and reservedCount
+            // more for fields added later on
+            static json getValidatedCustomFields(const json& fields, double sampleRate, int reservedCount = 0);
             void updateSessionTime();
+            int64_t getStoredEventCount();
+
+            // opened on first use, once the database location is known
+            store::IEventStore& eventStore();
+
+            // evicts down to the trim target, true if the store is within the budget afterwards
+            bool makeRoomInStore();
+
+            // the store's size, also published for getStoreSizeBytes
+            int64_t storeSizeBytes();
+
+            // appends the stored json text to the request body as it is, client_ts was validated when it was stored
+            static void addEventToPayload(std::string& payload, std::string_view event, std::string_view annotations);
+
+            // moves the annotation fields of the event which the event data didn't set into out.annotations
+            static void splitAnnotations(json& event, json const& eventData, BufferedEvent& out);
+            // the event with its annotations, the cached static ones are joined in as text unless the event sets one of them
+            void buildStoredEvent(json const& eventData, BufferedEvent& out);
+
+            void sendBufferedEvents(std::string const& requestIdentifier);
+            void storeEvents(std::vector<BufferedEvent> const& events);
+
+            // runs on the io thread
+            void sendEvents(std::string const& requestIdentifier, std::size_t eventCount, std::string const& payload);
+            void onEventsSent(std::string const& requestIdentifier, std::size_t eventCount, http::EGAHTTPApiResponse responseEnum, const json& dataDict);
 
             bool isRunning  {false};
             bool keepRunning{false};
+
+            // request identifiers of batches handed to the io thread, only accessed on the ga thread
+            std::vector<std::string> _requestsInFlight;
+
+            // write-behind buffer, only accessed on the ga thread
+            bool                                                       _isWriteBehind = false;
+            std::size_t                                                _maxBufferedEvents = 0;
+            threading::GAThreading::TimerId                            _spillTimer = threading::GAThreading::InvalidTimerId;
+            std::deque<BufferedEvent>                                  _bufferedEvents;
+            std::unordered_map<std::string, std::vector<BufferedEvent>> _bufferedInFlight;
+            bool                                                       _isSessionTimeDirty = false;
+
+            std::atomic<int>                    _eventStoreType = EventStoreSqlite;
+            std::unique_ptr<store::IEventStore> _eventStore;
+            std::atomic<int64_t>                _storeBudgetBytes = DefaultStoreBudgetBytes;
+            std::atomic<int64_t>                _storeSizeBytes = 0;
+            std::atomic<bool>                   _isCompactStorage = false;
+
+            GAEventSampler                      _sampler;
+
+            // design event aggregation, only accessed on the ga thread
+            struct AggregatedEvent
+            {
+                json    eventData;
+                bool    hasValue = false;
+                int64_t count = 0;
+                double  sum = 0;
+                double  min = 0;
+                double  max = 0;
+            };
+
+            bool                                             _isAggregating = false;
+            threading::GAThreading::TimerId                  _aggregationTimer = threading::GAThreading::InvalidTimerId;
+            std::unordered_map<std::string, AggregatedEvent> _aggregatedEvents;
         };
     }
 }
@@ -154,9 +154,9 @@ namespace gameanalytics
             }
         }
 
-        EGAHTTPApiResponse GAHTTPApi::sendEventsInArray(json& json_out, const json& eventArray)
+        EGAHTTPApiResponse GAHTTPApi::sendEventsInArray(json& json_out, std::string const& eventArray)
         {
-            if (eventArray.empty())
+            if (eventArray.empty() || eventArray == "[]")
             {
                 logging::GALogger::d("sendEventsInArray called with missing eventArray");
                 return JsonEncodeFailed;
@@ -170,12 +170,7 @@ namespace gameanalytics
                 const std::string url = baseUrl + '/' + gameKey + '/' + eventsUrlPath;
                 logging::GALogger::d("Sending 'events' URL: %s", url.c_str());
 
-                std::string const jsonString = eventArray.dump();
-                if (jsonString.empty())
-                {
-                    logging::GALogger::d("sendEventsInArray JSON encoding failed of eventArray");
-                    return JsonEncodeFailed;
-                }
+                std::string const& jsonString = eventArray;
 
                 std::vector<uint8_t> payloadData = createPayloadData(jsonString, useGzip);
 
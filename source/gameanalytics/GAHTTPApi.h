@@ -131,7 +131,8 @@ namespace gameanalytics
             static GAHTTPApi& getInstance();
 
             EGAHTTPApiResponse requestInitReturningDict(json& json_out, std::string const& configsHash);
-            EGAHTTPApiResponse sendEventsInArray(json& json_out, const json& eventArray);
+            // eventArray is the json text of the events array, sent as it is
+            EGAHTTPApiResponse sendEventsInArray(json& json_out, std::string const& eventArray);
             void sendSdkErrorEvent(EGASdkErrorCategory category, EGASdkErrorArea area, EGASdkErrorAction action, EGASdkErrorParameter parameter, std::string const& reason, std::string const& gameKey, std::string const& secretKey);            
 
         private:
@@ -0,0 +1,539 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#include "GALogEventStore.h"
+#include "GALogger.h"
+#include "GAUtilities.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#if IS_WIN32 || IS_UWP
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace gameanalytics
+{
+    namespace store
+    {
+        namespace
+        {
+            constexpr const char* SegmentPrefix = "events-";
+            constexpr const char* SegmentSuffix = ".log";
+
+            // records are a little endian header (payload length, crc32 of the payload) followed by "category\nevent"
+            void writeUint32(unsigned char* out, uint32_t value)
+            {
+                out[0] = static_cast<unsigned char>(value);
+                out[1] = static_cast<unsigned char>(value >> 8);
+                out[2] = static_cast<unsigned char>(value >> 16);
+                out[3] = static_cast<unsigned char>(value >> 24);
+            }
+
+            uint32_t readUint32(const unsigned char* in)
+            {
+                return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) | (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+            }
+
+            // reads the record at the current file position, false at the end of the valid records
+            bool readRecord(std::FILE* file, std::string& payload)
+            {
+                unsigned char header[8];
+                if (std::fread(header, 1, sizeof(header), file) != sizeof(header))
+                {
+                    return false;
+                }
+
+                const uint32_t length = readUint32(header);
+                const uint32_t crc    = readUint32(header + 4);
+
+                // a torn header can claim any length
+                if (length > 16 * 1024 * 1024)
+                {
+                    return false;
+                }
+
+                payload.resize(length);
+                if (length > 0 && std::fread(&payload[0], 1, length, file) != length)
+                {
+                    return false;
+                }
+
+                return utilities::GAUtilities::computeCrc32(payload.data(), payload.size()) == crc;
+            }
+        }
+
+        GALogEventStore::GALogEventStore(std::filesystem::path const& directory):
+            _directory(directory)
+        {
+            _isOpen = open();
+            if (!_isOpen)
+            {
+                logging::GALogger::w("Could not open event log: %s", _directory.string().c_str());
+            }
+        }
+
+        GALogEventStore::~GALogEventStore()
+        {
+            if (_appendFile)
+            {
+                std::fclose(_appendFile);
+            }
+        }
+
+        std::filesystem::path GALogEventStore::segmentPath(uint64_t segment) const
+        {
+            return _directory / utilities::printString("%s%020" PRIu64 "%s", SegmentPrefix, segment, SegmentSuffix);
+        }
+
+        bool GALogEventStore::open()
+        {
+            std::error_code error;
+            std::filesystem::create_directories(_directory, error);
+            if (error)
+            {
+                return false;
+            }
+
+            for (auto const& entry : std::filesystem::directory_iterator(_directory, error))
+            {
+                const std::string name = entry.path().filename().string();
+                if (name.size() <= strlen(SegmentPrefix) + strlen(SegmentSuffix) || name.compare(0, strlen(SegmentPrefix), SegmentPrefix) != 0)
+                {
+                    continue;
+                }
+
+                try
+                {
+                    const uint64_t segment = std::stoull(name.substr(strlen(SegmentPrefix)));
+                    _segments[segment].bytes = static_cast<int64_t>(std::filesystem::file_size(entry.path()));
+                }
+                catch (const std::exception&)
+                {
+                    continue;
+                }
+            }
+
+            if (error)
+            {
+                return false;
+            }
+
+            Position checkpoint;
+            if (!readCheckpoint(checkpoint))
+            {
+                checkpoint = { _segments.empty() ? 1 : _segments.begin()->first, 0 };
+            }
+
+            // everything before the checkpoint was acked
+            while (!_segments.empty() && _segments.begin()->first < checkpoint.segment)
+            {
+                dropSegment(_segments.begin()->first);
+            }
+
+            if (_segments.empty() || _segments.begin()->first != checkpoint.segment)
+            {
+                checkpoint = { _segments.empty() ? std::max<uint64_t>(checkpoint.segment, 1) : _segments.begin()->first, 0 };
+            }
+
+            _checkpoint    = checkpoint;
+            _claimPosition = checkpoint;
+
+            for (auto& segment : _segments)
+            {
+                segment.second.events = scanSegment(segment.first, segment.first == _checkpoint.segment ? _checkpoint.offset : 0);
+                _eventCount += segment.second.events;
+                _byteCount  += segment.second.bytes;
+            }
+
+            return openForAppend(_segments.empty() ? _checkpoint.segment : _segments.rbegin()->first);
+        }
+
+        int64_t GALogEventStore::scanSegment(uint64_t segment, int64_t from)
+        {
+            Segment& info = _segments[segment];
+
+            std::FILE* file = std::fopen(segmentPath(segment).string().c_str(), "rb");
+            if (!file)
+            {
+                info.bytes = 0;
+                return 0;
+            }
+
+            int64_t events = 0;
+            int64_t offset = std::min(from, info.bytes);
+
+            std::string payload;
+            if (std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0)
+            {
+                while (offset < info.bytes && readRecord(file, payload))
+                {
+                    offset += static_cast<int64_t>(RecordHeaderSize + payload.size());
+                    ++events;
+                }
+            }
+
+            std::fclose(file);
+
+            // the app was killed in the middle of a write, drop the partial record
+            if (offset < info.bytes)
+            {
+                logging::GALogger::w("Event log: dropping %lld bytes of a partly written record", static_cast<long long>(info.bytes - offset));
+
+                std::error_code error;
+                std::filesystem::resize_file(segmentPath(segment), static_cast<std::uintmax_t>(offset), error);
+                info.bytes = offset;
+            }
+
+            return events;
+        }
+
+        bool GALogEventStore::openForAppend(uint64_t segment)
+        {
+            if (_appendFile)
+            {
+                std::fclose(_appendFile);
+            }
+
+            _appendFile    = std::fopen(segmentPath(segment).string().c_str(), "ab");
+            _appendSegment = segment;
+
+            // creates the entry for a new segment
+            _segments[segment];
+
+            return _appendFile != nullptr;
+        }
+
+        bool GALogEventStore::append(GAStoredEvent const& event)
+        {
+            if (!_isOpen)
+            {
+                return false;
+            }
+
+            if (_segments[_appendSegment].bytes >= SegmentMaxBytes && !openForAppend(_appendSegment + 1))
+            {
+                logging::GALogger::e("Event log: could not create a new segment");
+                return false;
+            }
+
+            std::string record(RecordHeaderSize, '\0');
+            record.reserve(RecordHeaderSize + event.category.size() + 1 + event.annotations.size() + event.event.size() + 1);
+            record += event.category;
+            record += '\n';
+            record += event.annotations.empty() ? event.event : event.text();
+
+            const std::size_t length = record.size() - RecordHeaderSize;
+            writeUint32(reinterpret_cast<unsigned char*>(&record[0]), static_cast<uint32_t>(length));
+            writeUint32(reinterpret_cast<unsigned char*>(&record[4]), utilities::GAUtilities::computeCrc32(record.data() + RecordHeaderSize, length));
+
+            // flushed right away so claims, which read through their own handle, see it
+            if (std::fwrite(record.data(), 1, record.size(), _appendFile) != record.size() || std::fflush(_appendFile) != 0)
+            {
+                logging::GALogger::e("Event log: could not write event");
+                return false;
+            }
+
+            Segment& segment = _segments[_appendSegment];
+            segment.bytes += static_cast<int64_t>(record.size());
+            segment.events += 1;
+            _eventCount += 1;
+            _byteCount  += static_cast<int64_t>(record.size());
+
+            return true;
+        }
+
+        bool GALogEventStore::readRange(Range& range, std::size_t maxEvents, EventCallback const& onEvent)
+        {
+            range.end   = range.begin;
+            range.count = 0;
+
+            auto segment = _segments.find(range.segment);
+            if (segment == _segments.end())
+            {
+                return false;
+            }
+
+            std::FILE* file = std::fopen(segmentPath(range.segment).string().c_str(), "rb");
+            if (!file)
+            {
+                return false;
+            }
+
+            bool ok = std::fseek(file, static_cast<long>(range.begin), SEEK_SET) == 0;
+
+            std::string payload;
+            while (ok && static_cast<std::size_t>(range.count) < maxEvents && range.end < segment->second.bytes)
+            {
+                if (!readRecord(file, payload))
+                {
+                    ok = false;
+                    break;
+                }
+
+                range.end += static_cast<int64_t>(RecordHeaderSize + payload.size());
+                range.count += 1;
+
+                const std::size_t separator = payload.find('\n');
+                onEvent(std::string_view(payload).substr(separator == std::string::npos ? 0 : separator + 1), {});
+            }
+
+            std::fclose(file);
+            return ok;
+        }
+
+        void GALogEventStore::claimRange(std::string const& requestId, Range const& range)
+        {
+            _claims[requestId] = range;
+        }
+
+        int64_t GALogEventStore::claimBatch(std::string const& requestId, std::string const& /*category*/, std::size_t maxEvents, EventCallback const& onEvent)
+        {
+            if (!_isOpen)
+            {
+                return -1;
+            }
+
+            // failed batches go out again first, as they were
+            if (!_retries.empty())
+            {
+                Range range = _retries.front();
+                _retries.pop_front();
+
+                const int64_t count = range.count;
+                if (!readRange(range, static_cast<std::size_t>(count), onEvent))
+                {
+                    logging::GALogger::e("Event log: could not read events for retry");
+                    return -1;
+                }
+
+                claimRange(requestId, range);
+                return range.count;
+            }
+
+            // move on to the next segment once this one is read to the end
+            while (_claimPosition.segment < _appendSegment && _claimPosition.offset >= _segments[_claimPosition.segment].bytes)
+            {
+                auto next = _segments.upper_bound(_claimPosition.segment);
+                _claimPosition = { next->first, 0 };
+            }
+
+            Range range;
+            range.segment = _claimPosition.segment;
+            range.begin   = _claimPosition.offset;
+
+            if (!readRange(range, maxEvents, onEvent))
+            {
+                logging::GALogger::e("Event log: could not read events");
+                return -1;
+            }
+
+            _claimPosition.offset = range.end;
+
+            if (range.count > 0)
+            {
+                claimRange(requestId, range);
+            }
+
+            return range.count;
+        }
+
+        void GALogEventStore::ack(std::string const& requestId)
+        {
+            auto claim = _claims.find(requestId);
+            if (claim == _claims.end())
+            {
+                return;
+            }
+
+            auto segment = _segments.find(claim->second.segment);
+            if (segment != _segments.end())
+            {
+                segment->second.events -= claim->second.count;
+                _eventCount -= claim->second.count;
+            }
+
+            _claims.erase(claim);
+            updateCheckpoint();
+        }
+
+        void GALogEventStore::nack(std::string const& requestId)
+        {
+            auto claim = _claims.find(requestId);
+            if (claim == _claims.end())
+            {
+                return;
+            }
+
+            const Range range = claim->second;
+            _claims.erase(claim);
+
+            auto at = std::upper_bound(_retries.begin(), _retries.end(), range,
+                [](Range const& a, Range const& b) { return Position{a.segment, a.begin} < Position{b.segment, b.begin}; });
+            _retries.insert(at, range);
+        }
+
+        void GALogEventStore::nackAll()
+        {
+            std::vector<std::string> requests;
+            for (auto const& claim : _claims)
+            {
+                requests.push_back(claim.first);
+            }
+
+            for (std::string const& requestId : requests)
+            {
+                nack(requestId);
+            }
+        }
+
+        void GALogEventStore::updateCheckpoint()
+        {
+            Position oldest = _claimPosition;
+            for (auto const& claim : _claims)
+            {
+                oldest = std::min(oldest, Position{claim.second.segment, claim.second.begin});
+            }
+
+            for (Range const& retry : _retries)
+            {
+                oldest = std::min(oldest, Position{retry.segment, retry.begin});
+            }
+
+            if (!(_checkpoint < oldest))
+            {
+                return;
+            }
+
+            _checkpoint = oldest;
+
+            // written next to it and renamed, so a crash leaves either the old or the new checkpoint
+            const std::filesystem::path tmpPath = _directory / (std::string(CheckpointFile) + ".tmp");
+            std::FILE* file = std::fopen(tmpPath.string().c_str(), "wb");
+            if (!file)
+            {
+                logging::GALogger::w("Event log: could not write checkpoint");
+                return;
+            }
+
+            std::fprintf(file, "%" PRIu64 " %" PRId64, _checkpoint.segment, _checkpoint.offset);
+            std::fclose(file);
+
+            std::error_code error;
+            std::filesystem::rename(tmpPath, _directory / CheckpointFile, error);
+
+            // segments before the checkpoint were sent completely
+            while (!_segments.empty() && _segments.begin()->first < _checkpoint.segment)
+            {
+                dropSegment(_segments.begin()->first);
+            }
+        }
+
+        bool GALogEventStore::readCheckpoint(Position& out) const
+        {
+            std::FILE* file = std::fopen((_directory / CheckpointFile).string().c_str(), "rb");
+            if (!file)
+            {
+                return false;
+            }
+
+            const bool ok = std::fscanf(file, "%" SCNu64 " %" SCNd64, &out.segment, &out.offset) == 2;
+            std::fclose(file);
+
+            return ok;
+        }
+
+        void GALogEventStore::dropSegment(uint64_t segment)
+        {
+            auto it = _segments.find(segment);
+            if (it == _segments.end() || segment == _appendSegment)
+            {
+                return;
+            }
+
+            _eventCount -= it->second.events;
+            _byteCount  -= it->second.bytes;
+
+            // the requests still in flight have nothing left to ack and failed batches can't be read for a retry any more
+            const std::size_t batches = _claims.size() + _retries.size();
+            for (auto claim = _claims.begin(); claim != _claims.end();)
+            {
+                claim = claim->second.segment == segment ? _claims.erase(claim) : std::next(claim);
+            }
+
+            _retries.erase(std::remove_if(_retries.begin(), _retries.end(), [segment](Range const& r) { return r.segment == segment; }), _retries.end());
+
+            if (batches > _claims.size() + _retries.size())
+            {
+                logging::GALogger::d("Event log: forgot %zu batches of dropped segment %" PRIu64, batches - _claims.size() - _retries.size(), segment);
+            }
+
+            std::error_code error;
+            std::filesystem::remove(segmentPath(segment), error);
+
+            _segments.erase(it);
+        }
+
+        int64_t GALogEventStore::trim(int64_t maxBytes)
+        {
+            int64_t removed = 0;
+
+            // whole segments go, the one being appended to stays
+            while (sizeBytes() > maxBytes && _segments.size() > 1)
+            {
+                removed += _segments.begin()->second.events;
+                dropSegment(_segments.begin()->first);
+            }
+
+            if (removed > 0)
+            {
+                logging::GALogger::w("Event log too large. Deleted the oldest %lld events.", static_cast<long long>(removed));
+            }
+
+            if (!_segments.empty() && _claimPosition.segment < _segments.begin()->first)
+            {
+                _claimPosition = { _segments.begin()->first, 0 };
+            }
+
+            updateCheckpoint();
+
+            return removed;
+        }
+
+        bool GALogEventStore::compact(std::chrono::milliseconds /*budget*/)
+        {
+            // segments are deleted as a whole, there is nothing left over to give back
+            return false;
+        }
+
+        void GALogEventStore::sync()
+        {
+            if (!_appendFile)
+            {
+                return;
+            }
+
+            std::fflush(_appendFile);
+
+#if IS_WIN32 || IS_UWP
+            _commit(_fileno(_appendFile));
+#else
+            fsync(fileno(_appendFile));
+#endif
+        }
+
+        int64_t GALogEventStore::size()
+        {
+            return _eventCount;
+        }
+
+        int64_t GALogEventStore::sizeBytes()
+        {
+            return _byteCount;
+        }
+    }
+}
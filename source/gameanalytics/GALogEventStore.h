@@ -0,0 +1,108 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#pragma once
+
+#include "GAEventStore.h"
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+namespace gameanalytics
+{
+    namespace store
+    {
+        // append-only log of events split into segment files, with a checkpoint file holding the oldest event not acked yet.
+        // Appending is a sequential write and claiming a batch reads on from the claim cursor, there is no table to scan.
+        // The category filter of claimBatch is ignored, batches are always taken in order.
+        // Events acked ahead of older pending ones are only dropped once the checkpoint passes them, so they can be sent
+        // a second time if the app is killed before that
+        class GALogEventStore : public IEventStore
+        {
+         public:
+
+            explicit GALogEventStore(std::filesystem::path const& directory);
+            ~GALogEventStore() override;
+
+            GALogEventStore(const GALogEventStore&) = delete;
+            GALogEventStore& operator=(const GALogEventStore&) = delete;
+
+            bool append(GAStoredEvent const& event) override;
+
+            int64_t claimBatch(std::string const& requestId, std::string const& category, std::size_t maxEvents, EventCallback const& onEvent) override;
+            void ack(std::string const& requestId) override;
+            void nack(std::string const& requestId) override;
+            void nackAll() override;
+
+            int64_t trim(int64_t maxBytes) override;
+            bool compact(std::chrono::milliseconds budget) override;
+            void sync() override;
+
+            int64_t size() override;
+            int64_t sizeBytes() override;
+
+         private:
+
+            static constexpr int64_t     SegmentMaxBytes = 262144;
+            static constexpr std::size_t RecordHeaderSize = 8;
+            static constexpr const char* CheckpointFile = "checkpoint";
+
+            struct Position
+            {
+                uint64_t segment = 0;
+                int64_t  offset  = 0;
+
+                bool operator<(Position const& other) const
+                {
+                    return segment < other.segment || (segment == other.segment && offset < other.offset);
+                }
+            };
+
+            // claims never span segments, so a segment can be dropped with everything in it
+            struct Range
+            {
+                uint64_t segment = 0;
+                int64_t  begin   = 0;
+                int64_t  end     = 0;
+                int64_t  count   = 0;
+            };
+
+            struct Segment
+            {
+                int64_t bytes  = 0;
+                // events past the checkpoint which are not acked
+                int64_t events = 0;
+            };
+
+            bool open();
+            bool openForAppend(uint64_t segment);
+            int64_t scanSegment(uint64_t segment, int64_t from);
+            std::filesystem::path segmentPath(uint64_t segment) const;
+
+            // reads up to maxEvents records starting at range.begin, range.end and range.count are set to what was read
+            bool readRange(Range& range, std::size_t maxEvents, EventCallback const& onEvent);
+            void claimRange(std::string const& requestId, Range const& range);
+
+            bool readCheckpoint(Position& out) const;
+            void updateCheckpoint();
+            void dropSegment(uint64_t segment);
+
+            std::filesystem::path _directory;
+            bool                  _isOpen = false;
+
+            std::FILE*            _appendFile = nullptr;
+            uint64_t              _appendSegment = 0;
+
+            std::map<uint64_t, Segment>            _segments;
+            Position                               _claimPosition;
+            Position                               _checkpoint;
+            std::unordered_map<std::string, Range> _claims;
+            std::deque<Range>                      _retries;
+            int64_t                                _eventCount = 0;
+            int64_t                                _byteCount = 0;
+        };
+    }
+}
@@ -0,0 +1,265 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#include "GASqliteEventStore.h"
+#include "GAStore.h"
+#include "GALogger.h"
+#include "GAUtilities.h"
+#include <algorithm>
+
+namespace gameanalytics
+{
+    namespace store
+    {
+        namespace
+        {
+            // evicted first to last once the store is over its budget, session and business events are never evicted
+            constexpr const char* EvictionOrder[] = {"health", "design", "progression", "resource", "error", "sdk_init"};
+
+            // the other columns and the index entries of a row, on top of the event text
+            constexpr int64_t RowOverheadBytes = 96;
+
+            // pages given back per incremental vacuum step
+            constexpr int VacuumStepPages = 32;
+        }
+
+        GASqliteEventStore::GASqliteEventStore()
+        {
+            // fragments of sessions whose events are all sent
+            GAStore::executeQuerySync("DELETE FROM ga_annotations WHERE id NOT IN (SELECT DISTINCT annotations FROM ga_events);");
+        }
+
+        bool GASqliteEventStore::append(GAStoredEvent const& event)
+        {
+            constexpr const char* sql = "INSERT INTO ga_events (status, category, session_id, client_ts, event, annotations) VALUES(0, ?, ?, ?, ?, ?);";
+
+            // stored whole if the fragment can't be stored
+            int64_t annotations = event.annotations.empty() ? 0 : annotationsId(event.annotations);
+
+            // the integer columns convert the bound text
+            json result;
+            GAStore::executeQuerySync(sql, { std::to_string(GAStore::getEventCategoryCode(event.category)), event.sessionId, event.clientTs,
+                annotations > 0 || event.annotations.empty() ? event.event : event.text(), std::to_string(annotations) }, result);
+
+            return !result.is_null();
+        }
+
+        int64_t GASqliteEventStore::annotationsId(std::string const& fragment)
+        {
+            auto cached = _annotationIds.find(fragment);
+            if (cached != _annotationIds.end())
+            {
+                return cached->second;
+            }
+
+            GAStore::executeQuerySync("INSERT OR IGNORE INTO ga_annotations (fragment) VALUES(?);", {fragment});
+
+            int64_t id = 0;
+            GAStore::queryRowsSync("SELECT id FROM ga_annotations WHERE fragment = ?;", {fragment},
+                [&id](GAStoreRow const& row)
+                {
+                    id = row.getInt64(0);
+                    return false;
+                });
+
+            if (id > 0)
+            {
+                _annotationIds.emplace(fragment, id);
+            }
+
+            return id;
+        }
+
+        int64_t GASqliteEventStore::claimBatch(std::string const& requestId, std::string const& category, std::size_t maxEvents, EventCallback const& onEvent)
+        {
+            // the sql text stays the same between calls so the compiled statements can be reused
+            const char* andCategory = category.empty() ? "" : " AND category = ?";
+
+            const std::string claimId = std::to_string(takeClaimId(requestId));
+
+            StringVector claimParameters = {claimId};
+            if (!category.empty())
+            {
+                claimParameters.push_back(std::to_string(GAStore::getEventCategoryCode(category)));
+            }
+
+            // claim the oldest events first, then read back what was claimed. Both are lookups on the status index
+            const std::string claimSql = utilities::printString("UPDATE ga_events SET status = ? WHERE rowid IN (SELECT rowid FROM ga_events WHERE status = 0%s ORDER BY client_ts ASC LIMIT %zu);", andCategory, maxEvents);
+
+            json claimResult;
+            GAStore::executeQuerySync(claimSql, claimParameters, claimResult);
+            if (claimResult.is_null())
+            {
+                _claimIds.erase(requestId);
+                return -1;
+            }
+
+            int64_t eventCount = 0;
+            const bool ok = GAStore::queryRowsSync("SELECT e.event, a.fragment FROM ga_events e LEFT JOIN ga_annotations a ON a.id = e.annotations WHERE e.status = ?;", {claimId},
+                [&onEvent, &eventCount](GAStoreRow const& row)
+                {
+                    ++eventCount;
+                    onEvent(row.getText(0), row.isNull(1) ? std::string_view() : row.getText(1));
+                    return true;
+                });
+
+            if (eventCount == 0)
+            {
+                _claimIds.erase(requestId);
+            }
+
+            return ok ? eventCount : -1;
+        }
+
+        int64_t GASqliteEventStore::takeClaimId(std::string const& requestId)
+        {
+            if (_nextClaimId == 0)
+            {
+                _nextClaimId = 1;
+                GAStore::queryRowsSync("SELECT MAX(status) FROM ga_events;", {},
+                    [this](GAStoreRow const& row)
+                    {
+                        if (!row.isNull(0))
+                        {
+                            _nextClaimId = std::max<int64_t>(row.getInt64(0) + 1, 1);
+                        }
+                        return false;
+                    });
+            }
+
+            const int64_t claimId = _nextClaimId++;
+            _claimIds[requestId] = claimId;
+
+            return claimId;
+        }
+
+        void GASqliteEventStore::ack(std::string const& requestId)
+        {
+            auto claim = _claimIds.find(requestId);
+            if (claim == _claimIds.end())
+            {
+                return;
+            }
+
+            GAStore::executeQuerySync("DELETE FROM ga_events WHERE status = ?;", {std::to_string(claim->second)});
+            _claimIds.erase(claim);
+        }
+
+        void GASqliteEventStore::nack(std::string const& requestId)
+        {
+            auto claim = _claimIds.find(requestId);
+            if (claim == _claimIds.end())
+            {
+                return;
+            }
+
+            GAStore::executeQuerySync("UPDATE ga_events SET status = 0 WHERE status = ?;", {std::to_string(claim->second)});
+            _claimIds.erase(claim);
+        }
+
+        void GASqliteEventStore::nackAll()
+        {
+            // a range on the status index instead of a scan for != 0
+            GAStore::executeQuerySync("UPDATE ga_events SET status = 0 WHERE status > 0;");
+            _claimIds.clear();
+        }
+
+        int64_t GASqliteEventStore::trim(int64_t maxBytes)
+        {
+            // the cached size is behind by the writes of the open group
+            int64_t excess = GAStore::refreshDbUsedBytes() - maxBytes;
+            if (excess <= 0)
+            {
+                return 0;
+            }
+
+            const int64_t before = size();
+
+            for (const char* category : EvictionOrder)
+            {
+                const std::string code = std::to_string(GAStore::getEventCategoryCode(category));
+
+                // the row sizes are an estimate, so the category is evicted in rounds until enough is freed or it is empty
+                while (excess > 0)
+                {
+                    // oldest first until enough is freed, on the category index. The rowid breaks ties within the
+                    // same second, client_ts alone would take every event of the last second with it
+                    int64_t freed = 0;
+                    int64_t lastTimestamp = -1;
+                    int64_t lastRowId = -1;
+                    GAStore::queryRowsSync("SELECT client_ts, rowid, LENGTH(event) FROM ga_events WHERE category = ? AND status = 0 ORDER BY client_ts ASC, rowid ASC;", {code},
+                        [&freed, &lastTimestamp, &lastRowId, excess](GAStoreRow const& row)
+                        {
+                            lastTimestamp = row.getInt64(0);
+                            lastRowId = row.getInt64(1);
+                            freed += row.getInt64(2) + RowOverheadBytes;
+                            return freed < excess;
+                        });
+
+                    if (lastTimestamp < 0)
+                    {
+                        break;
+                    }
+
+                    GAStore::executeQuerySync("DELETE FROM ga_events WHERE category = ? AND status = 0 AND (client_ts, rowid) <= (?, ?);",
+                        {code, std::to_string(lastTimestamp), std::to_string(lastRowId)});
+
+                    excess = GAStore::refreshDbUsedBytes() - maxBytes;
+                }
+
+                if (excess <= 0)
+                {
+                    break;
+                }
+            }
+
+            const int64_t removed = before - size();
+            if (removed > 0)
+            {
+                logging::GALogger::w("Database too large. Deleted %lld events, the least valuable and oldest first.", static_cast<long long>(removed));
+            }
+
+            return removed;
+        }
+
+        bool GASqliteEventStore::compact(std::chrono::milliseconds budget)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + budget;
+
+            int64_t freePages = 0;
+            do
+            {
+                freePages = GAStore::incrementalVacuum(VacuumStepPages);
+            }
+            while (freePages > 0 && std::chrono::steady_clock::now() < deadline);
+
+            return freePages > 0;
+        }
+
+        void GASqliteEventStore::sync()
+        {
+            GAStore::commitPendingWrites();
+        }
+
+        int64_t GASqliteEventStore::size()
+        {
+            int64_t count = -1;
+            GAStore::queryRowsSync("SELECT COUNT(*) FROM ga_events;", {},
+                [&count](GAStoreRow const& row)
+                {
+                    count = row.getInt64(0);
+                    return false;
+                });
+
+            return count;
+        }
+
+        int64_t GASqliteEventStore::sizeBytes()
+        {
+            // free pages are given back by compact, they don't count against the budget
+            return GAStore::getDbUsedBytes();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+//
+// GA-SDK-CPP
+// Copyright 2018 GameAnalytics C++ SDK. All rights reserved.
+//
+
+#pragma once
+
+#include "GAEventStore.h"
+#include <unordered_map>
+
+namespace gameanalytics
+{
+    namespace store
+    {
+        // the ga_events table in the sdk's database. New events have status 0, claimed ones the id of their batch
+        class GASqliteEventStore : public IEventStore
+        {
+         public:
+
+            GASqliteEventStore();
+
+            bool append(GAStoredEvent const& event) override;
+
+            int64_t claimBatch(std::string const& requestId, std::string const& category, std::size_t maxEvents, EventCallback const& onEvent) override;
+            void ack(std::string const& requestId) override;
+            void nack(std::string const& requestId) override;
+            void nackAll() override;
+
+            int64_t trim(int64_t maxBytes) override;
+            bool compact(std::chrono::milliseconds budget) override;
+            void sync() override;
+
+            int64_t size() override;
+            int64_t sizeBytes() override;
+
+         private:
+
+            // the status column is an integer, so request ids are mapped to batch ids
+            int64_t takeClaimId(std::string const& requestId);
+
+            // row id of the annotation fragment in ga_annotations, added if it is new. 0 on errors
+            int64_t annotationsId(std::string const& fragment);
+
+            // starts past the claims a killed app left behind
+            int64_t _nextClaimId = 0;
+            std::unordered_map<std::string, int64_t> _claimIds;
+
+            // fragments change about once per session
+            std::unordered_map<std::string, int64_t> _annotationIds;
+        };
+    }
+}
@@ -94,6 +94,7 @@ namespace gameanalytics
         void GAState::setExternalUserId(std::string const& id)
         {
             getInstance()._externalUserId = id;
+            invalidateAnnotations();
         }
 
         std::string GAState::getSessionId()
@@ -191,6 +192,7 @@ namespace gameanalytics
         void GAState::setBuild(std::string const& build)
         {
             getInstance()._build = build;
+            invalidateAnnotations();
             logging::GALogger::i("Set build: %s", build.c_str());
         }
 
@@ -391,50 +393,109 @@ namespace gameanalytics
                 events::GAEvents::stopEventQueue();
             }
 
+            // nothing may be left only in memory once the app is suspended or quits
+            events::GAEvents::flushAggregatedEvents();
+            events::GAEvents::spillBufferedEvents();
+
             if(endThread)
             {
                 threading::GAThreading::endThread();
             }
         }
 
+        std::atomic<uint64_t> GAState::_annotationsVersion{1};
+
         void GAState::getEventAnnotations(json& out)
         {
+            try
+            {
+                out.update(getStaticAnnotations());
+                addVariableAnnotations(out);
+            }
+            catch (json::exception const& e)
+            {
+                logging::GALogger::e("getEventAnnotations - json error: %s", e.what());
+            }
+            catch(std::exception const& e)
+            {
+                logging::GALogger::e("getEventAnnotations - exception thrown: %s", e.what());
+            }
+        }
+
+        void GAState::addVariableAnnotations(json& out)
+        {
+            out["event_uuid"] = utilities::GAUtilities::generateUUID();
+            out["client_ts"] = utilities::GAUtilities::timeIntervalSince1970();
+            out["session_num"] = getInstance()._sessionNum;
+            out["connection_type"] = device::GADevice::getConnectionType();
+        }
+
+        void GAState::invalidateAnnotations()
+        {
+            ++_annotationsVersion;
+        }
+
+        json const& GAState::getStaticAnnotations()
+        {
+            GAState& state = getInstance();
+            if (state._staticAnnotationsVersion != _annotationsVersion)
+            {
+                state.cacheStaticAnnotations();
+            }
+
+            return state._staticAnnotations;
+        }
+
+        std::string const& GAState::getStaticAnnotationsText()
+        {
+            GAState& state = getInstance();
+            if (state._staticAnnotationsVersion != _annotationsVersion)
+            {
+                state.cacheStaticAnnotations();
+            }
+
+            return state._staticAnnotationsText;
+        }
+
+        void GAState::cacheStaticAnnotations()
+        {
+            // read first, a setter running meanwhile leaves the cache behind so it is rebuilt on the next use
+            const uint64_t version = _annotationsVersion;
+
+            json out = json::object();
+
             try
             {
                 // ---- REQUIRED ---- //
 
                 // collector event API version
                 out["v"] = 2;
-                out["event_uuid"] = utilities::GAUtilities::generateUUID();
-                
+
                 // User identifier
                 out["user_id"] = getUserId();
-                
+
                 // remote configs configurations
-                if(getInstance()._trackingRemoteConfigsJson.is_array() && !getInstance()._trackingRemoteConfigsJson.empty())
+                if(_trackingRemoteConfigsJson.is_array() && !_trackingRemoteConfigsJson.empty())
                 {
-                    out["configurations_v3"] = getInstance().getRemoteConfigAnnotations();
+                    out["configurations_v3"] = getRemoteConfigAnnotations();
                 }
 
                 out["sdk_version"] = device::GADevice::getRelevantSdkVersion();
-                out["client_ts"] = utilities::GAUtilities::timeIntervalSince1970();
                 out["os_version"] = device::GADevice::getOSVersion();
                 out["manufacturer"] = device::GADevice::getDeviceManufacturer();
                 out["device"] = device::GADevice::getDeviceModel();
                 out["platform"] = device::GADevice::getBuildPlatform();
-                out["session_id"] = getInstance()._sessionId;
-                out["session_num"] = getInstance()._sessionNum;
-                out["connection_type"] = device::GADevice::getConnectionType();
+                out["session_id"] = _sessionId;
 
                 // ---- OPTIONAL ---- //
 
                 // A/B testing
-                utilities::addIfNotEmpty(out, "ab_id", getInstance()._abId);
-                utilities::addIfNotEmpty(out, "ab_variant_id", getInstance()._abVariantId);
-                
-                utilities::addIfNotEmpty(out, "user_id_ext", getInstance()._externalUserId);
+                utilities::addIfNotEmpty(out, "ab_id", _abId);
+                utilities::addIfNotEmpty(out, "ab_variant_id", _abVariantId);
 
-                utilities::addIfNotEmpty(out, "build", getInstance()._build);
+                utilities::addIfNotEmpty(out, "user_id_ext", _externalUserId);
+
+                utilities::addIfNotEmpty(out, "build", _build);
                 utilities::addIfNotEmpty(out, "engine_version", device::GADevice::getGameEngineVersion());
 
 #if USE_UWP
@@ -444,12 +505,17 @@ namespace gameanalytics
             }
             catch (json::exception const& e)
             {
-                logging::GALogger::e("getEventAnnotations - json error: %s", e.what());
+                logging::GALogger::e("cacheStaticAnnotations - json error: %s", e.what());
             }
             catch(std::exception const& e)
             {
-                logging::GALogger::e("getEventAnnotations - exception thrown: %s", e.what());
+                logging::GALogger::e("cacheStaticAnnotations - exception thrown: %s", e.what());
             }
+
+            _staticAnnotationsText = out.dump();
+            _staticAnnotationsText = _staticAnnotationsText.substr(1, _staticAnnotationsText.size() - 2);
+            _staticAnnotations = std::move(out);
+            _staticAnnotationsVersion = version;
         }
 
         void GAState::getSdkErrorEventAnnotations(json& out)
@@ -515,6 +581,9 @@ namespace gameanalytics
                 _identifier = _defaultUserId;
             }
 
+            invalidateAnnotations();
+            events::GAEvents::sampler().setUserId(_identifier);
+
             logging::GALogger::d("identifier, {clean:%s}", _identifier.c_str());
         }
 
@@ -635,6 +704,7 @@ namespace gameanalytics
                     _configsHash = utilities::getOptionalValue<std::string>(currentSdkConfig, "configs_hash");
                     _abId        = utilities::getOptionalValue<std::string>(currentSdkConfig, "ab_id");
                     _abVariantId = utilities::getOptionalValue<std::string>(currentSdkConfig, "ab_variant_id");
+                    invalidateAnnotations();
                 }
 
                 json gaProgression;
@@ -719,6 +789,7 @@ namespace gameanalytics
                     _configsHash = utilities::getOptionalValue<std::string>(initResponseDict, "configs_hash");
                     _abId        = utilities::getOptionalValue<std::string>(initResponseDict, "ab_id");
                     _abVariantId = utilities::getOptionalValue<std::string>(initResponseDict, "ab_variant_id");
+                    invalidateAnnotations();
 
                     // insert new config in sql lite cross session storage
                     store::GAStore::setState("sdk_config_cached", initResponseDict.dump());
@@ -816,6 +887,7 @@ namespace gameanalytics
 
                 // Set session id
                 _sessionId = utilities::toLowerCase(newSessionId);
+                invalidateAnnotations();
 
                 // Set session start
                 _sessionStart = getClientTsAdjusted();
@@ -914,6 +986,7 @@ namespace gameanalytics
         {
             _gameRemoteConfigsJson = json::array();
             _trackingRemoteConfigsJson = json::array();
+            invalidateAnnotations();
 
             for (const auto& configuration : remoteCfgs)
             {
@@ -966,6 +1039,10 @@ namespace gameanalytics
 
                 buildRemoteConfigsJsons(_tempRemoteConfigsJson);
 
+                // sampling rules can be changed without a new release
+                const char* samplingKey = events::GAEventSampler::RemoteConfigKey;
+                events::GAEvents::sampler().setRemoteRules(_tempRemoteConfigsJson.contains(samplingKey) ? _tempRemoteConfigsJson[samplingKey]["value"] : json());
+
                 _remoteConfigsIsReady = true;
                 
                 std::string const configStr = _gameRemoteConfigsJson.dump();
@@ -997,7 +1074,7 @@ namespace gameanalytics
             });
         }
 
-        void GAState::validateAndCleanCustomFields(const json& fields, json& out)
+        void GAState::validateAndCleanCustomFields(const json& fields, json& out, int maxCount)
         {
             try
             {
@@ -1018,7 +1095,7 @@ namespace gameanalytics
                             logging::GALogger::w(msg.c_str());
                             addErrorEvent(EGAErrorSeverity::Warning, msg);
                         }
-                        else if(count < MAX_CUSTOM_FIELDS_COUNT)
+                        else if(count < maxCount)
                         {
                             char pattern[MAX_CUSTOM_FIELDS_KEY_LENGTH + 1] = "";
                             snprintf(pattern, std::size(pattern), "^[a-zA-Z0-9_]{1,%d}$", MAX_CUSTOM_FIELDS_KEY_LENGTH);
@@ -1066,7 +1143,7 @@ namespace gameanalytics
                         else
                         {
                             constexpr const char* fmt = "validateAndCleanCustomFields: entry with key=%s has been omitted because it exceeds the max number of custom fields (%d)";
-                            LogAndAddErrorEvent(EGAErrorSeverity::Warning, fmt, key.c_str(), MAX_CUSTOM_FIELDS_COUNT);
+                            LogAndAddErrorEvent(EGAErrorSeverity::Warning, fmt, key.c_str(), maxCount);
                         }
                     }
                 }
@@ -1145,11 +1222,13 @@ namespace gameanalytics
         void GAState::setAbId(std::string const& abId)
         {
             getInstance()._abId = abId;
+            invalidateAnnotations();
         }
 
         void GAState::setAbVariantId(std::string const& abVariantId)
         {
             getInstance()._abVariantId = abVariantId;
+            invalidateAnnotations();
         }
 
         std::string GAState::getAbId()
@@ -1171,7 +1250,7 @@ namespace gameanalytics
             return cleanedFields;
         }
 
-        json GAState::getValidatedCustomFields(const json& withEventFields)
+        json GAState::getValidatedCustomFields(const json& withEventFields, int maxCount)
         {
             json cleanedFields, d;
             getGlobalCustomEventFields(d);
@@ -1179,7 +1258,7 @@ namespace gameanalytics
             if(!withEventFields.empty())
                 d.merge_patch(withEventFields);
             
-            getInstance().validateAndCleanCustomFields(d, cleanedFields);
+            getInstance().validateAndCleanCustomFields(d, cleanedFields, maxCount);
 
             return cleanedFields;
         }
@@ -9,6 +9,7 @@
 #include <map>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <cstdlib>
 #include <unordered_map>
 
@@ -123,6 +124,15 @@ namespace gameanalytics
                 static void endSessionAndStopQueue(bool endThread);
                 static void resumeSessionAndStartQueue();
                 static void getEventAnnotations(json& out);
+
+                // the annotations which are the same for every event until one of their inputs changes, i.e. all except
+                // event_uuid, client_ts, session_num and connection_type. Rebuilt on first use after invalidateAnnotations,
+                // ga thread only
+                static json const& getStaticAnnotations();
+                // the same as json fields without the braces, ready to be joined with the event's own fields
+                static std::string const& getStaticAnnotationsText();
+                static void addVariableAnnotations(json& out);
+                static void invalidateAnnotations();
                 static void getSdkErrorEventAnnotations(json& out);
                 static void getInitAnnotations(json& out);
                 static void internalInitialize();
@@ -144,7 +154,8 @@ namespace gameanalytics
                 static std::string getExternalUserId();
 
                 static json getValidatedCustomFields();
-                static json getValidatedCustomFields(const json& withEventFields);
+                // maxCount leaves room for fields the sdk adds after validating
+                static json getValidatedCustomFields(const json& withEventFields, int maxCount = MAX_CUSTOM_FIELDS_COUNT);
 
                 template<typename T>
                 inline static T getRemoteConfigsValue(std::string const& key, T const& defaultValue)
@@ -202,7 +213,7 @@ namespace gameanalytics
 
             int64_t calculateServerTimeOffset(int64_t serverTs);
 
-            void validateAndCleanCustomFields(const json& fields, json& out);
+            void validateAndCleanCustomFields(const json& fields, json& out, int maxCount = MAX_CUSTOM_FIELDS_COUNT);
 
             void setConfigsHash(std::string const& configsHash);
             void setAbId(std::string const& abId);
@@ -275,6 +286,14 @@ namespace gameanalytics
             
             json _gameRemoteConfigsJson;
             json _trackingRemoteConfigsJson;
+
+            void cacheStaticAnnotations();
+
+            // bumped from the setters, can run before the instance exists
+            static std::atomic<uint64_t> _annotationsVersion;
+            uint64_t    _staticAnnotationsVersion = 0;
+            json        _staticAnnotations;
+            std::string _staticAnnotationsText;
             
             bool _remoteConfigsIsReady;
             std::vector<std::shared_ptr<IRemoteConfigsListener>> _remoteConfigsListeners;
@@ -16,8 +16,67 @@ namespace gameanalytics
 {
     namespace store
     {
-        constexpr int MaxDbSizeBytes            = 6291456;
-        constexpr int MaxDbSizeBytesBeforeTrim  = 5242880;
+        // the database is capped at a few MB, so this keeps all of it in memory
+        constexpr int StorageCacheSizeKb    = 2048;
+        constexpr int StorageMmapSizeBytes  = 8388608;
+
+        // 2: ga_events with integer status, category and client_ts columns and indexes for the queue queries
+        // 3: annotation fields shared by many events can be stored once in ga_annotations
+        constexpr int EventSchemaVersion = 3;
+
+        // enough for every query the sdk runs, one off queries just cycle through the oldest slots
+        constexpr std::size_t MaxCachedStatements = 32;
+
+        // autocommit writes between two size refreshes, each refresh costs two pragma queries. Trimming reads the exact size
+        constexpr int UsedBytesRefreshWrites = 32;
+
+        namespace
+        {
+            // case insensitive, without the regex the per event queries used to go through
+            bool startsWithKeyword(std::string const& sql, const char* keyword)
+            {
+                const std::size_t length = strlen(keyword);
+                if (sql.size() < length)
+                {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < length; ++i)
+                {
+                    if (std::toupper(static_cast<unsigned char>(sql[i])) != keyword[i])
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            bool isWriteStatement(std::string const& sql)
+            {
+                return startsWithKeyword(sql, "UPDATE") || startsWithKeyword(sql, "INSERT") || startsWithKeyword(sql, "DELETE");
+            }
+
+            struct EventCategoryCode
+            {
+                const char* category;
+                int         code;
+            };
+
+            // stored in the database, codes must never be reused for another category
+            constexpr EventCategoryCode EventCategoryCodes[] =
+            {
+                {"user",        1},
+                {"session_end", 2},
+                {"business",    3},
+                {"resource",    4},
+                {"progression", 5},
+                {"design",      6},
+                {"error",       7},
+                {"sdk_init",    8},
+                {"health",      9}
+            };
+        }
 
         GAStore::GAStore()
         {
@@ -25,6 +84,12 @@ namespace gameanalytics
 
         GAStore::~GAStore()
         {
+            {
+                std::lock_guard<std::mutex> guard(statementMutex);
+                commitGroup();
+            }
+
+            finalizeStatements();
         }
 
         GAStore& GAStore::getInstance()
@@ -64,142 +129,269 @@ namespace gameanalytics
 
         void GAStore::executeQuerySync(std::string const& sql, StringVector const& parameters, bool useTransaction, json& out)
         {
+            out = json::array();
+
+            auto addRow = [&out](GAStoreRow const& row)
+            {
+                json rowDict;
+                for (int i = 0; i < row.columnCount(); i++)
+                {
+                    const char *column = row.columnName(i);
+                    if (!column || row.isNull(i))
+                    {
+                        continue;
+                    }
+
+                    switch (sqlite3_column_type(row.statement, i))
+                    {
+                        case SQLITE_INTEGER:
+                        {
+                            rowDict[column] = row.getInt64(i);
+                            break;
+                        }
+                        case SQLITE_FLOAT:
+                        {
+                            rowDict[column] = row.getDouble(i);
+                            break;
+                        }
+                        default:
+                        {
+                            rowDict[column] = row.getText(i);
+                        }
+                    }
+                }
+
+                out.push_back(std::move(rowDict));
+                return true;
+            };
+
+            if (!getInstance().runQuery(sql, parameters, useTransaction, addRow))
+            {
+                out = {};
+            }
+        }
+
+        bool GAStore::queryRowsSync(std::string const& sql, StringVector const& parameters, RowCallback const& onRow)
+        {
+            return getInstance().runQuery(sql, parameters, false, onRow);
+        }
+
+        bool GAStore::runQuery(std::string const& sql, StringVector const& parameters, bool useTransaction, RowCallback const& onRow)
+        {
+            std::lock_guard<std::mutex> guard(statementMutex);
+
+            sqlite3_stmt *statement = nullptr;
+            bool hasTransaction = false;
+
             try
             {
                 // Force transaction if it is an update, insert or delete.
-                if (utilities::GAUtilities::stringMatch(utilities::toUpperCase(sql), "^(UPDATE|INSERT|DELETE)"))
+                const bool isWrite = isWriteStatement(sql);
+                if (isWrite)
                 {
                     useTransaction = true;
                 }
 
-                // Get database connection from singelton getInstance
-                sqlite3 *sqlDatabasePtr = getInstance().getDatabase();
+                // can't run inside a transaction
+                if (groupOpen && startsWithKeyword(sql, "VACUUM"))
+                {
+                    commitGroup();
+                }
+
+                if (!groupOpen && isWrite && groupCommitEnabled && threading::GAThreading::isGAThread())
+                {
+                    beginGroup();
+                }
+
+                // the group's transaction covers it
+                if (groupOpen)
+                {
+                    useTransaction = false;
+                    groupWrites += isWrite ? 1 : 0;
+                }
 
                 if (useTransaction)
                 {
-                    if (sqlite3_exec(sqlDatabasePtr, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+                    if (sqlite3_exec(sqlDatabase, "BEGIN;", 0, 0, 0) != SQLITE_OK)
                     {
-                        logging::GALogger::e("SQLITE3 BEGIN ERROR: %s", sqlite3_errmsg(sqlDatabasePtr));
-                        return;
+                        logging::GALogger::e("SQLITE3 BEGIN ERROR: %s", sqlite3_errmsg(sqlDatabase));
+                        return false;
                     }
+
+                    hasTransaction = true;
                 }
 
-                out = json::array();
+                // Get the cached statement or prepare it
+                statement = prepareStatement(sql);
+                if (!statement)
+                {
+                    // TODO(nikolaj): Should we do a db validation to see if the db is corrupt here?
+                    logging::GALogger::e("SQLITE3 PREPARE ERROR: %s", sqlite3_errmsg(sqlDatabase));
+                    return false;
+                }
 
-                // Create statement
-                sqlite3_stmt *statement = nullptr;
+                // Bind parameters
+                for (size_t index = 0; index < parameters.size(); index++)
+                {
+                    sqlite3_bind_text(statement, static_cast<int>(index + 1), parameters[index].c_str(), -1, 0);
+                }
 
-                // Prepare statement
-                if (sqlite3_prepare_v2(sqlDatabasePtr, sql.c_str(), -1, &statement, nullptr) == SQLITE_OK)
+                const bool isReadOnly = sqlite3_stmt_readonly(statement) != 0;
+
+                // Loop through results
+                const GAStoreRow row(statement);
+                while (sqlite3_step(statement) == SQLITE_ROW)
                 {
-                    // Bind parameters
-                    if (!parameters.empty())
+                    if (!onRow(row))
                     {
-                        for (size_t index = 0; index < parameters.size(); index++)
-                        {
-                            sqlite3_bind_text(statement, static_cast<int>(index + 1), parameters[index].c_str(), -1, 0);
-                        }
+                        break;
                     }
+                }
+
+                // Reset statement for the next use, the bound parameters point into the caller's strings
+                const int result = sqlite3_reset(statement);
+                sqlite3_clear_bindings(statement);
+                statement = nullptr;
 
-                    // get columns count
-                    int columnCount = sqlite3_column_count(statement);
+                if (result != SQLITE_OK)
+                {
+                    logging::GALogger::d("SQLITE3 STEP ERROR: %s", sqlite3_errmsg(sqlDatabase));
 
-                    // Loop through results
-                    while (sqlite3_step(statement) == SQLITE_ROW)
+                    if (hasTransaction && sqlite3_exec(sqlDatabase, "ROLLBACK", 0, 0, 0) != SQLITE_OK)
                     {
-                        json row;
-                        for (int i = 0; i < columnCount; i++)
-                        {
-                            const char *column = sqlite3_column_name(statement, i);
-                            const char *value  = reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
-
-                            if (!column || !value)
-                            {
-                                continue;
-                            }
-
-                            switch (sqlite3_column_type(statement, i))
-                            {
-                                case SQLITE_INTEGER:
-                                {
-                                    try
-                                    {
-                                        int64_t valInt = std::stoll(value);
-                                        row[column] = valInt;
-                                    }
-                                    catch(std::exception& e)
-                                    {
-                                        logging::GALogger::w("Failed to parse int: %s", e.what());
-                                    }
-
-                                    break;
-                                }
-                                case SQLITE_FLOAT:
-                                {
-                                    try
-                                    {
-                                        double valFloat = std::stod(value);
-                                        row[column] = valFloat;
-                                    }
-                                    catch(std::exception& e)
-                                    {
-                                        logging::GALogger::w("Failed to parse float: %s", e.what());
-                                    }
-                                    
-                                    break;
-                                }
-                                default:
-                                {
-                                    row[column] = value;
-                                }
-                            }
-                        }
-                        out.push_back(std::move(row));
+                        logging::GALogger::e("SQLITE3 ROLLBACK ERROR: %s", sqlite3_errmsg(sqlDatabase));
                     }
+
+                    return false;
                 }
-                else
+
+                if (hasTransaction && sqlite3_exec(sqlDatabase, "COMMIT", 0, 0, 0) != SQLITE_OK)
                 {
-                    // TODO(nikolaj): Should we do a db validation to see if the db is corrupt here?
-                    logging::GALogger::e("SQLITE3 PREPARE ERROR: %s", sqlite3_errmsg(sqlDatabasePtr));
-                    out = {};
-                    return;
+                    logging::GALogger::e("SQLITE3 COMMIT ERROR: %s", sqlite3_errmsg(sqlDatabase));
+                    return false;
                 }
 
-                // Destroy statement
-                if (sqlite3_finalize(statement) == SQLITE_OK)
+                // writes of the open group are counted when it commits, others every few writes
+                if (!isReadOnly && !groupOpen && ++writesSinceRefresh >= UsedBytesRefreshWrites)
                 {
-                    if (useTransaction)
-                    {
-                        if (sqlite3_exec(sqlDatabasePtr, "COMMIT", 0, 0, 0) != SQLITE_OK)
-                        {
-                            logging::GALogger::e("SQLITE3 COMMIT ERROR: %s", sqlite3_errmsg(sqlDatabasePtr));
-                            out = {};
-                            return;
-                        }
-                    }
+                    refreshUsedBytes();
                 }
-                else
+
+                if (groupOpen)
                 {
-                    logging::GALogger::d("SQLITE3 FINALIZE ERROR: %s", sqlite3_errmsg(sqlDatabasePtr));
+                    const bool isFull = groupWrites >= groupMaxWrites.load(std::memory_order_relaxed);
+                    const bool isLate = std::chrono::steady_clock::now() - groupStart >= std::chrono::milliseconds(groupMaxLatencyMs.load(std::memory_order_relaxed));
 
-                    if (useTransaction)
+                    if (isFull || isLate)
                     {
-                        if (sqlite3_exec(sqlDatabasePtr, "ROLLBACK", 0, 0, 0) != SQLITE_OK)
-                        {
-                            logging::GALogger::e("SQLITE3 ROLLBACK ERROR: %s", sqlite3_errmsg(sqlDatabasePtr));
-                        }
-
-                        out = {};
+                        commitGroup();
                     }
-
-                    return;
                 }
+
+                return true;
             }
             catch(std::exception& e)
             {
                 logging::GALogger::e("Exception thrown: %s", e.what());
-                out = {};
+
+                if (statement)
+                {
+                    sqlite3_reset(statement);
+                    sqlite3_clear_bindings(statement);
+                }
+
+                if (hasTransaction)
+                {
+                    sqlite3_exec(sqlDatabase, "ROLLBACK", 0, 0, 0);
+                }
+
+                return false;
+            }
+        }
+
+        GAStoreRow::GAStoreRow(sqlite3_stmt* statement):
+            statement(statement)
+        {
+        }
+
+        int GAStoreRow::columnCount() const
+        {
+            return sqlite3_column_count(statement);
+        }
+
+        const char* GAStoreRow::columnName(int column) const
+        {
+            return sqlite3_column_name(statement, column);
+        }
+
+        bool GAStoreRow::isNull(int column) const
+        {
+            return sqlite3_column_type(statement, column) == SQLITE_NULL;
+        }
+
+        int64_t GAStoreRow::getInt64(int column) const
+        {
+            return sqlite3_column_int64(statement, column);
+        }
+
+        double GAStoreRow::getDouble(int column) const
+        {
+            return sqlite3_column_double(statement, column);
+        }
+
+        std::string_view GAStoreRow::getText(int column) const
+        {
+            // the length has to be read after the text, the conversion to text can change it
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+            if (!text)
+            {
+                return {};
+            }
+
+            return std::string_view(text, static_cast<std::size_t>(sqlite3_column_bytes(statement, column)));
+        }
+
+        sqlite3_stmt* GAStore::prepareStatement(std::string const& sql)
+        {
+            auto it = statementCache.find(sql);
+            if (it != statementCache.end())
+            {
+                statementUsage.splice(statementUsage.begin(), statementUsage, it->second.usage);
+                return it->second.statement;
+            }
+
+            sqlite3_stmt *statement = nullptr;
+            if (sqlite3_prepare_v2(sqlDatabase, sql.c_str(), -1, &statement, nullptr) != SQLITE_OK || !statement)
+            {
+                sqlite3_finalize(statement);
+                return nullptr;
+            }
+
+            if (statementCache.size() >= MaxCachedStatements)
+            {
+                auto oldest = statementCache.find(statementUsage.back());
+                sqlite3_finalize(oldest->second.statement);
+                statementCache.erase(oldest);
+                statementUsage.pop_back();
+            }
+
+            statementUsage.push_front(sql);
+            statementCache.emplace(sql, CachedStatement{statement, statementUsage.begin()});
+
+            return statement;
+        }
+
+        void GAStore::finalizeStatements()
+        {
+            std::lock_guard<std::mutex> guard(statementMutex);
+
+            for (auto& entry : statementCache)
+            {
+                sqlite3_finalize(entry.second.statement);
             }
+
+            statementCache.clear();
+            statementUsage.clear();
         }
 
         sqlite3* GAStore::getDatabase()
@@ -267,19 +459,42 @@ namespace gameanalytics
                 getInstance().dbReady = true;
                 logging::GALogger::i("Database opened: %s", getInstance().dbPath.c_str());
             }
+
+            // before the storage profile, switching to WAL writes the header of a new database and fixes its auto_vacuum mode
+            if (!getInstance().enableIncrementalVacuum())
+            {
+                logging::GALogger::w("Could not enable incremental vacuum");
+            }
+
+            if (!getInstance().applyStorageProfile())
+            {
+                logging::GALogger::w("Could not apply the storage profile, using sqlite's defaults");
+            }
             
             if (dropDatabase)
             {
                 logging::GALogger::d("Drop tables");
                 GAStore::executeQuerySync("DROP TABLE ga_events");
+                GAStore::executeQuerySync("DROP TABLE ga_annotations");
                 GAStore::executeQuerySync("DROP TABLE ga_state");
                 GAStore::executeQuerySync("DROP TABLE ga_session");
                 GAStore::executeQuerySync("DROP TABLE ga_progression");
                 GAStore::executeQuerySync("VACUUM");
             }
 
+            if (!getInstance().migrateEventTable())
+            {
+                // the old rows can't be read with the new queries
+                logging::GALogger::w("Could not migrate ga_events to schema version %d, recreating it.", EventSchemaVersion);
+                GAStore::executeQuerySync("DROP TABLE ga_events");
+            }
+
             // Create statements
-            constexpr const char* sql_ga_events = "CREATE TABLE IF NOT EXISTS ga_events(status CHAR(50) NOT NULL, category CHAR(50) NOT NULL, session_id CHAR(50) NOT NULL, client_ts CHAR(50) NOT NULL, event TEXT NOT NULL);";
+            // status is 0 for new events or the id of the batch which claimed them, annotations is 0 for complete events
+            constexpr const char* sql_ga_events = "CREATE TABLE IF NOT EXISTS ga_events(status INTEGER NOT NULL, category INTEGER NOT NULL, session_id CHAR(50) NOT NULL, client_ts INTEGER NOT NULL, event TEXT NOT NULL, annotations INTEGER NOT NULL DEFAULT 0);";
+            constexpr const char* sql_ga_annotations = "CREATE TABLE IF NOT EXISTS ga_annotations(id INTEGER PRIMARY KEY, fragment TEXT NOT NULL UNIQUE);";
+            constexpr const char* sql_ga_events_status_index = "CREATE INDEX IF NOT EXISTS ga_events_status ON ga_events(status, client_ts);";
+            constexpr const char* sql_ga_events_category_index = "CREATE INDEX IF NOT EXISTS ga_events_category ON ga_events(category, status, client_ts);";
             constexpr const char* sql_ga_session = "CREATE TABLE IF NOT EXISTS ga_session(session_id CHAR(50) PRIMARY KEY NOT NULL, timestamp CHAR(50) NOT NULL, event TEXT NOT NULL);";
             constexpr const char* sql_ga_state = "CREATE TABLE IF NOT EXISTS ga_state(key CHAR(255) PRIMARY KEY NOT NULL, value TEXT);";
             constexpr const char* sql_ga_progression = "CREATE TABLE IF NOT EXISTS ga_progression(progression CHAR(255) PRIMARY KEY NOT NULL, tries CHAR(255));";
@@ -301,6 +516,19 @@ namespace gameanalytics
                 }
             }
 
+            if (!GAStore::executeQuerySync(sql_ga_events_status_index) || !GAStore::executeQuerySync(sql_ga_events_category_index))
+            {
+                logging::GALogger::w("Could not create the ga_events indexes.");
+            }
+
+            if (!GAStore::executeQuerySync(sql_ga_annotations))
+            {
+                logging::GALogger::d("ensureDatabase failed: %s", sql_ga_annotations);
+                return false;
+            }
+
+            GAStore::executeQuerySync(utilities::printString("PRAGMA user_version = %d;", EventSchemaVersion));
+
             if (!GAStore::executeQuerySync(sql_ga_session))
             {
                 return false;
@@ -349,8 +577,8 @@ namespace gameanalytics
                 }
             }
 
-            getInstance().trimEventTable();
             getInstance().tableReady = true;
+            refreshDbUsedBytes();
 
             logging::GALogger::d("Database tables ensured present");
 
@@ -371,72 +599,339 @@ namespace gameanalytics
             }
         }
 
-        int64_t GAStore::getDbSizeBytes()
+        void GAStore::beginGroup()
         {
-            std::ifstream in(getInstance().dbPath, std::ifstream::ate | std::ifstream::binary);
-            return in.tellg();
+            if (sqlite3_exec(sqlDatabase, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+            {
+                logging::GALogger::e("SQLITE3 BEGIN ERROR: %s", sqlite3_errmsg(sqlDatabase));
+                return;
+            }
+
+            groupOpen   = true;
+            groupWrites = 0;
+            groupStart  = std::chrono::steady_clock::now();
+
+            // runs once the blocks already queued are done, so a backlog drained in one go ends up in one transaction
+            if (!groupCommitQueued)
+            {
+                groupCommitQueued = true;
+                threading::GAThreading::performTaskOnGAThread(
+                    []()
+                    {
+                        GAStore& instance = getInstance();
+                        std::lock_guard<std::mutex> guard(instance.statementMutex);
+
+                        instance.groupCommitQueued = false;
+                        instance.commitGroup();
+                    }
+                );
+            }
         }
 
-        bool GAStore::getTableReady()
+        void GAStore::commitGroup()
         {
-            return getInstance().tableReady;
+            if (!groupOpen)
+            {
+                return;
+            }
+
+            groupOpen = false;
+
+            if (sqlite3_exec(sqlDatabase, "COMMIT", 0, 0, 0) != SQLITE_OK)
+            {
+                logging::GALogger::e("SQLITE3 COMMIT ERROR: %s", sqlite3_errmsg(sqlDatabase));
+
+                // don't leave the connection stuck in the transaction
+                if (sqlite3_exec(sqlDatabase, "ROLLBACK", 0, 0, 0) != SQLITE_OK)
+                {
+                    logging::GALogger::e("SQLITE3 ROLLBACK ERROR: %s", sqlite3_errmsg(sqlDatabase));
+                }
+            }
+
+            refreshUsedBytes();
         }
 
-        bool GAStore::isDbTooLargeForEvents()
+        int64_t GAStore::readPragma(const char* sql)
         {
-            return getDbSizeBytes() > MaxDbSizeBytes;
+            sqlite3_stmt* statement = prepareStatement(sql);
+            if (!statement)
+            {
+                return -1;
+            }
+
+            const int64_t value = sqlite3_step(statement) == SQLITE_ROW ? sqlite3_column_int64(statement, 0) : -1;
+            sqlite3_reset(statement);
+
+            return value;
         }
 
-        bool GAStore::trimEventTable()
+        void GAStore::refreshUsedBytes()
         {
-            if(getDbSizeBytes() > MaxDbSizeBytesBeforeTrim)
+            if (!sqlDatabase)
             {
-                try
-                {
-                    json resultSessionArray;
-                    executeQuerySync("SELECT session_id, Max(client_ts) FROM ga_events GROUP BY session_id ORDER BY client_ts LIMIT 3", resultSessionArray);
+                return;
+            }
 
-                    if(!resultSessionArray.is_null() && resultSessionArray.size() > 0)
-                    {
-                        std::string sessionDeleteString;
+            // fixed once the database exists
+            if (pageSize <= 0)
+            {
+                pageSize = readPragma("PRAGMA page_size;");
+            }
 
-                        unsigned int i = 0;
-                        for (auto itr = resultSessionArray.begin(); itr != resultSessionArray.end(); ++itr)
-                        {
-                            std::string const session_id = itr->get<std::string>();
-
-                            if(i < resultSessionArray.size() - 1)
-                            {
-                                sessionDeleteString += session_id + ",";
-                            }
-                            else
-                            {
-                                sessionDeleteString += session_id;
-                            }
-                            ++i;
-                        }
+            writesSinceRefresh = 0;
 
-                        const std::string deleteOldSessionsSql = utilities::printString("DELETE FROM ga_events WHERE session_id IN (\"%s\");", sessionDeleteString.c_str());
-                        logging::GALogger::w("Database too large when initializing. Deleting the oldest 3 sessions.");
-                        executeQuerySync(deleteOldSessionsSql);
-                        executeQuerySync("VACUUM");
+            const int64_t pageCount = readPragma("PRAGMA page_count;");
+            const int64_t freePages = readPragma("PRAGMA freelist_count;");
 
-                        return true;
-                    }
-                    else
-                    {
-                        return false;
-                    }
+            if (pageSize > 0 && pageCount >= 0 && freePages >= 0)
+            {
+                usedBytes = (pageCount - freePages) * pageSize;
+            }
+        }
+
+        void GAStore::setGroupCommit(bool enabled, std::size_t maxWrites, std::chrono::milliseconds maxLatency)
+        {
+            GAStore& instance = getInstance();
+
+            instance.groupMaxWrites     = std::max<std::size_t>(maxWrites, 1);
+            instance.groupMaxLatencyMs  = std::max<int64_t>(maxLatency.count(), 0);
+            instance.groupCommitEnabled = enabled;
+        }
+
+        void GAStore::commitPendingWrites()
+        {
+            GAStore& instance = getInstance();
+            std::lock_guard<std::mutex> guard(instance.statementMutex);
+
+            instance.commitGroup();
+        }
+
+        bool GAStore::hasPendingWrites()
+        {
+            GAStore& instance = getInstance();
+            std::lock_guard<std::mutex> guard(instance.statementMutex);
+
+            return instance.groupOpen;
+        }
+
+        void GAStore::setStorageProfile(EGAStorageProfile profile)
+        {
+            getInstance().storageProfile = profile;
+        }
+
+        bool GAStore::applyStorageProfile()
+        {
+            std::string pragmas;
+
+            switch (storageProfile.load())
+            {
+                case StorageDurable:
+                {
+                    // sqlite's defaults, the journal mode is stored in the file so it has to be switched back
+                    pragmas = "PRAGMA journal_mode=DELETE; PRAGMA synchronous=FULL;";
+                    break;
+                }
+                case StorageFast:
+                {
+                    pragmas = "PRAGMA journal_mode=WAL; PRAGMA synchronous=OFF;";
+                    break;
                 }
-                catch(std::exception& e)
+                default:
                 {
-                    logging::GALogger::e("Exception thrown: %s", e.what());
+                    // in WAL mode NORMAL only syncs on checkpoints, commits can't corrupt the database but the last ones may be lost on power loss
+                    pragmas = "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;";
+                    break;
+                }
+            }
+
+            pragmas += utilities::printString("PRAGMA cache_size=-%d; PRAGMA mmap_size=%d; PRAGMA temp_store=MEMORY;", StorageCacheSizeKb, StorageMmapSizeBytes);
+
+            char* error = nullptr;
+            if (sqlite3_exec(sqlDatabase, pragmas.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+            {
+                logging::GALogger::w("SQLITE3 PRAGMA ERROR: %s", error ? error : sqlite3_errmsg(sqlDatabase));
+                sqlite3_free(error);
+                return false;
+            }
+
+            return true;
+        }
+
+        bool GAStore::migrateEventTable()
+        {
+            int64_t version = 0;
+            queryRowsSync("PRAGMA user_version;", {},
+                [&version](GAStoreRow const& row)
+                {
+                    version = row.getInt64(0);
                     return false;
+                });
+
+            if (version >= EventSchemaVersion)
+            {
+                return true;
+            }
+
+            bool hasEventTable = false;
+            queryRowsSync("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'ga_events';", {},
+                [&hasEventTable](GAStoreRow const&)
+                {
+                    hasEventTable = true;
+                    return false;
+                });
+
+            // a new database gets the current schema right away
+            if (!hasEventTable)
+            {
+                return true;
+            }
+
+            logging::GALogger::i("Migrating ga_events to schema version %d", EventSchemaVersion);
+
+            std::string categoryCase = "CASE category";
+            for (EventCategoryCode const& entry : EventCategoryCodes)
+            {
+                categoryCase += utilities::printString(" WHEN '%s' THEN %d", entry.category, entry.code);
+            }
+            categoryCase += " ELSE 0 END";
+
+            std::string migration = "BEGIN;";
+
+            // claims of the text schema belong to uploads of an earlier run, those events go out again
+            if (version < 2)
+            {
+                migration +=
+                    "CREATE TABLE ga_events_v2(status INTEGER NOT NULL, category INTEGER NOT NULL, session_id CHAR(50) NOT NULL, client_ts INTEGER NOT NULL, event TEXT NOT NULL);"
+                    "INSERT INTO ga_events_v2 (status, category, session_id, client_ts, event) SELECT 0, " + categoryCase + ", session_id, CAST(client_ts AS INTEGER), event FROM ga_events;"
+                    "DROP TABLE ga_events;"
+                    "ALTER TABLE ga_events_v2 RENAME TO ga_events;";
+            }
+
+            // the existing rows are complete events
+            migration += "ALTER TABLE ga_events ADD COLUMN annotations INTEGER NOT NULL DEFAULT 0;";
+            migration += "COMMIT;";
+
+            std::lock_guard<std::mutex> guard(statementMutex);
+            commitGroup();
+
+            char* error = nullptr;
+            if (sqlite3_exec(sqlDatabase, migration.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+            {
+                logging::GALogger::e("SQLITE3 MIGRATION ERROR: %s", error ? error : sqlite3_errmsg(sqlDatabase));
+                sqlite3_free(error);
+
+                if (!sqlite3_get_autocommit(sqlDatabase))
+                {
+                    sqlite3_exec(sqlDatabase, "ROLLBACK", 0, 0, 0);
                 }
+
+                return false;
             }
 
             return true;
         }
 
+        bool GAStore::enableIncrementalVacuum()
+        {
+            int64_t autoVacuum = -1;
+            queryRowsSync("PRAGMA auto_vacuum;", {},
+                [&autoVacuum](GAStoreRow const& row)
+                {
+                    autoVacuum = row.getInt64(0);
+                    return false;
+                });
+
+            // 2 is INCREMENTAL
+            if (autoVacuum == 2)
+            {
+                return true;
+            }
+
+            if (!executeQuerySync("PRAGMA auto_vacuum = INCREMENTAL;"))
+            {
+                return false;
+            }
+
+            queryRowsSync("PRAGMA auto_vacuum;", {},
+                [&autoVacuum](GAStoreRow const& row)
+                {
+                    autoVacuum = row.getInt64(0);
+                    return false;
+                });
+
+            // the mode only changes by itself while the file is still empty, otherwise it takes a vacuum. Only needed once
+            if (autoVacuum != 2)
+            {
+                logging::GALogger::i("Switching the database to incremental vacuum");
+                return executeQuerySync("VACUUM");
+            }
+
+            return true;
+        }
+
+        int GAStore::getEventCategoryCode(std::string const& category)
+        {
+            for (EventCategoryCode const& entry : EventCategoryCodes)
+            {
+                if (category == entry.category)
+                {
+                    return entry.code;
+                }
+            }
+
+            return 0;
+        }
+
+        int64_t GAStore::getDbSizeBytes()
+        {
+            std::ifstream in(getInstance().dbPath, std::ifstream::ate | std::ifstream::binary);
+            return in.tellg();
+        }
+
+        int64_t GAStore::getDbUsedBytes()
+        {
+            const int64_t bytes = getInstance().usedBytes;
+            return bytes >= 0 ? bytes : getDbSizeBytes();
+        }
+
+        int64_t GAStore::refreshDbUsedBytes()
+        {
+            GAStore& instance = getInstance();
+            {
+                std::lock_guard<std::mutex> guard(instance.statementMutex);
+                instance.refreshUsedBytes();
+            }
+
+            return getDbUsedBytes();
+        }
+
+        int64_t GAStore::incrementalVacuum(int maxPages)
+        {
+            if (!executeQuerySync(utilities::printString("PRAGMA incremental_vacuum(%d);", maxPages)))
+            {
+                return -1;
+            }
+
+            int64_t freePages = -1;
+            queryRowsSync("PRAGMA freelist_count;", {},
+                [&freePages](GAStoreRow const& row)
+                {
+                    freePages = row.getInt64(0);
+                    return false;
+                });
+
+            return freePages;
+        }
+
+        bool GAStore::getTableReady()
+        {
+            return getInstance().tableReady;
+        }
+
+        std::filesystem::path GAStore::getStorageDirectory()
+        {
+            return std::filesystem::path(getInstance().dbPath).parent_path();
+        }
+
     }
 }
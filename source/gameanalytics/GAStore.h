@@ -7,14 +7,44 @@
 
 #include <sqlite3.h>
 #include <vector>
+#include <list>
+#include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <functional>
+#include <string_view>
 #include "GACommon.h"
 
 namespace gameanalytics
 {
     namespace store
     {
+        // typed view of the current result row, only valid inside the row callback
+        class GAStoreRow
+        {
+            friend class GAStore;
+
+         public:
+
+            int columnCount() const;
+            const char* columnName(int column) const;
+            bool isNull(int column) const;
+
+            int64_t getInt64(int column) const;
+            double getDouble(int column) const;
+
+            // points into sqlite's own buffer, copy it to keep it beyond the callback
+            std::string_view getText(int column) const;
+
+         private:
+
+            explicit GAStoreRow(sqlite3_stmt* statement);
+
+            sqlite3_stmt* statement = nullptr;
+        };
+
         class GAStore
         {
             friend class state::GAState;
@@ -27,6 +57,17 @@ namespace gameanalytics
 
             static void setState(std::string const& key, std::string const& value);
 
+            // applied when the database is opened
+            static void setStorageProfile(EGAStorageProfile profile);
+
+            // writes on the ga thread share one transaction, committed once the blocks queued so far have run,
+            // after maxWrites writes or once it is open for maxLatency, whichever comes first
+            static void setGroupCommit(bool enabled, std::size_t maxWrites, std::chrono::milliseconds maxLatency);
+
+            // commits the writes of the open group right away
+            static void commitPendingWrites();
+            static bool hasPendingWrites();
+
             static bool executeQuerySync(std::string const& sql);
             static void executeQuerySync(std::string const& sql, json& out);
 
@@ -36,10 +77,31 @@ namespace gameanalytics
             static void executeQuerySync(std::string const& sql, StringVector const& parameters, bool useTransaction);
             static void executeQuerySync(std::string const& sql, StringVector const& parameters, bool useTransaction, json& out);
 
+            // called for every result row, returning false stops reading the remaining rows
+            using RowCallback = std::function<bool(GAStoreRow const& row)>;
+
+            // reads the result rows without building json, returns false if the query failed
+            static bool queryRowsSync(std::string const& sql, StringVector const& parameters, RowCallback const& onRow);
+
             static int64_t getDbSizeBytes();
 
+            // bytes of the database in use, the free pages left behind by deleted rows don't count.
+            // Cached and refreshed when a group commits or every few autocommit writes, so this doesn't touch the database
+            static int64_t getDbUsedBytes();
+
+            // reads the size from the database right away, includes the writes of the open group
+            static int64_t refreshDbUsedBytes();
+
+            // gives up to maxPages free pages back to the file system, returns the number of free pages left or -1 on errors
+            static int64_t incrementalVacuum(int maxPages);
+
+            // ga_events keeps the category as a small integer since schema version 2, unknown categories are 0
+            static int getEventCategoryCode(std::string const& category);
+
             static bool getTableReady();
-            static bool isDbTooLargeForEvents();
+
+            // the directory holding the database, other sdk files are kept next to it
+            static std::filesystem::path getStorageDirectory();
 
         private:
 
@@ -51,9 +113,33 @@ namespace gameanalytics
             static GAStore& getInstance();
 
             bool fixOldDatabase();
-            bool trimEventTable();
             
             bool initDatabaseLocation();
+            bool applyStorageProfile();
+
+            // moves the rows of an older ga_events table over to the current schema
+            bool migrateEventTable();
+
+            // switches the database to auto_vacuum=INCREMENTAL, existing databases are vacuumed once for that
+            bool enableIncrementalVacuum();
+
+            bool runQuery(std::string const& sql, StringVector const& parameters, bool useTransaction, RowCallback const& onRow);
+
+            // called with the statement mutex held
+            void beginGroup();
+            void commitGroup();
+            void refreshUsedBytes();
+            int64_t readPragma(const char* sql);
+
+            // returns the compiled statement for the sql, prepared once and reused until evicted
+            sqlite3_stmt* prepareStatement(std::string const& sql);
+            void finalizeStatements();
+
+            struct CachedStatement
+            {
+                sqlite3_stmt*                    statement = nullptr;
+                std::list<std::string>::iterator usage;
+            };
 
             // set when calling "ensureDatabase"
             // using a "writablePath" that needs to be set into the C++ component before
@@ -67,6 +153,31 @@ namespace gameanalytics
             
             // bool to determine if tables are ensured ready
             bool tableReady = false;
+
+            // set from the game's thread before the database is opened on the ga thread
+            std::atomic<int> storageProfile = StorageBalanced;
+
+            // compiled statements by sql text, most recently used first
+            std::unordered_map<std::string, CachedStatement> statementCache;
+            std::list<std::string> statementUsage;
+
+            // held while a statement is in use, cached statements can't be shared. Also guards the write group
+            std::mutex statementMutex;
+
+            // the open write group
+            bool groupOpen = false;
+            bool groupCommitQueued = false;
+            std::size_t groupWrites = 0;
+            std::chrono::steady_clock::time_point groupStart;
+
+            std::atomic<bool>         groupCommitEnabled = false;
+            std::atomic<std::size_t>  groupMaxWrites = 256;
+            std::atomic<int64_t>      groupMaxLatencyMs = 50;
+
+            // (page_count - freelist_count) * page_size as of the last commit, -1 until the database is open
+            std::atomic<int64_t>      usedBytes = -1;
+            int64_t                   pageSize = 0;
+            int                       writesSinceRefresh = 0;
         };
     }
 }
@@ -10,16 +10,13 @@
 #include "GALogger.h"
 #include <thread>
 #include <exception>
+#include <cmath>
 #include "GAState.h"
 
 namespace gameanalytics
 {
     namespace threading
     {
-        using namespace std::chrono_literals;
-
-        constexpr std::chrono::milliseconds THREAD_TASK_FREQUENCY = 100ms;
-
         GAThreading& GAThreading::getInstance()
         {
             return state::GAState::getInstance()._gaThread;
@@ -32,14 +29,120 @@ namespace gameanalytics
 
         GAThreading::GAThreading()
         {
-            _thread = std::thread(
+        }
+
+        void GAThreading::ensureStarted()
+        {
+            std::call_once(_startFlag,
                 [this]()
-                { 
-                    work();
+                {
+                    // set first, thread settings changed from here on are posted to the threads
+                    _isStarted = true;
+
+                    if(!_isExternalPump)
+                    {
+                        _thread = std::thread(
+                            [this]()
+                            {
+                                work();
+                            }
+                        );
+
+                        _ioThread = std::thread(
+                            [this]()
+                            {
+                                ioWork();
+                            }
+                        );
+                    }
                 }
             );
         }
 
+        bool GAThreading::setExternalPump(bool enabled)
+        {
+            GAThreading& instance = getInstance();
+
+            if(instance._isStarted)
+            {
+                logging::GALogger::w("External pump mode must be configured before any other call to the SDK");
+                return false;
+            }
+
+            instance._isExternalPump = enabled;
+            return true;
+        }
+
+        bool GAThreading::isExternalPump()
+        {
+            return getInstance()._isExternalPump;
+        }
+
+        void GAThreading::pump(std::chrono::milliseconds timeBudget)
+        {
+            GAThreading& instance = getInstance();
+
+            if(!instance._isExternalPump)
+            {
+                return;
+            }
+
+            instance.ensureStarted();
+            instance.pumpWork(timeBudget);
+        }
+
+        void GAThreading::pumpWork(std::chrono::milliseconds timeBudget)
+        {
+            // blocks must be consumed by a single thread at a time
+            std::unique_lock<std::mutex> guard(_pumpMutex, std::try_to_lock);
+            if(!guard.owns_lock())
+            {
+                return;
+            }
+
+            const TimePoint deadline = Clock::now() + timeBudget;
+            _workerId = std::this_thread::get_id();
+
+            // every pump counts as a wake-up, so staged blocks wait at most one pump interval
+            drainStagingBuffers();
+
+            QueuedBlock b;
+            while(Clock::now() < deadline && getNextBlock(b))
+            {
+                runBlock(b, _blockWait, _blockRun, "ga");
+            }
+
+            if(Clock::now() < deadline)
+            {
+                updateTasks();
+            }
+
+            while(Clock::now() < deadline && getNextIOBlock(b))
+            {
+                runBlock(b, _ioWait, _ioRun, "io");
+            }
+
+            _workerId = std::thread::id();
+        }
+
+        bool GAThreading::isWorkerThread() const
+        {
+            return _workerId.load() == std::this_thread::get_id();
+        }
+
+        bool GAThreading::getNextIOBlock(QueuedBlock& out)
+        {
+            std::lock_guard<std::mutex> guard(_ioMutex);
+            if(_ioBlocks.empty())
+            {
+                return false;
+            }
+
+            out = std::move(_ioBlocks.front());
+            _ioBlocks.pop_front();
+            return true;
+        }
+
         GAThreading::~GAThreading()
         {
             flush();
@@ -47,77 +150,941 @@ namespace gameanalytics
     
         void GAThreading::flush()
         {
+            // the ga thread can't join itself and a block run by pump() can't wait for its own pump to finish
+            if(isWorkerThread())
+            {
+                logging::GALogger::w("The SDK can't be flushed from its own thread or the one calling pump()");
+                return;
+            }
+
             if(!_hasJoined)
             {
-                _endThread = true;
+                {
+                    std::unique_lock<std::mutex> guard(_wakeMutex);
+                    _endThread = true;
+                }
+
+                _hasWork.notify_all();
+
                 _hasJoined = true;
-                _thread.join();
-                
+                if(_thread.joinable())
+                {
+                    _thread.join();
+                }
+
+                // the ring buffer allows a single consumer, in external pump mode the host may still be pumping
+                std::lock_guard<std::mutex> guard(_pumpMutex);
+
                 // if there are any other tasks queued, flush them
+                drainStagingBuffers();
                 runBlocks();
                 updateTasks(true);
+
+                // finish pending uploads, their results are posted back as blocks
+                endIOThread();
+                drainStagingBuffers();
+                runBlocks();
+            }
+        }
+
+        void GAThreading::ioWork()
+        {
+            applyThreadSettings(true);
+
+            while(true)
+            {
+                QueuedBlock b;
+
+                {
+                    std::unique_lock<std::mutex> guard(_ioMutex);
+                    _hasIOWork.wait(guard, [this]() { return _endIOThread || !_ioBlocks.empty(); });
+
+                    // only leave once everything queued has been run
+                    if(_ioBlocks.empty())
+                    {
+                        return;
+                    }
+
+                    b = std::move(_ioBlocks.front());
+                    _ioBlocks.pop_front();
+                }
+
+                runBlock(b, _ioWait, _ioRun, "io");
+            }
+        }
+
+        void GAThreading::queueIOBlock(Task&& b)
+        {
+            {
+                std::unique_lock<std::mutex> guard(_ioMutex);
+                if(!_endIOThread)
+                {
+                    _ioBlocks.push_back({std::move(b), Clock::now()});
+                    guard.unlock();
+
+                    _hasIOWork.notify_one();
+                    return;
+                }
+            }
+
+            // the io thread is shutting down, run it on the caller instead of dropping it
+            QueuedBlock block{std::move(b), Clock::now()};
+            runBlock(block, _ioWait, _ioRun, "io");
+        }
+
+        void GAThreading::endIOThread()
+        {
+            {
+                std::lock_guard<std::mutex> guard(_ioMutex);
+                _endIOThread = true;
+            }
+
+            _hasIOWork.notify_all();
+
+            if(_ioThread.joinable())
+            {
+                _ioThread.join();
+            }
+
+            // nobody was running them in external pump mode
+            QueuedBlock b;
+            while(getNextIOBlock(b))
+            {
+                runBlock(b, _ioWait, _ioRun, "io");
             }
         }
 
         void GAThreading::runBlocks()
         {
-            while(!_blocks.empty())
+            QueuedBlock b;
+            while(getNextBlock(b))
             {
-                Block b = getNextBlock();
+                runBlock(b, _blockWait, _blockRun, "ga");
+            }
+        }
 
-                try
+        void GAThreading::runBlock(QueuedBlock& b, GALatencyHistogram& wait, GALatencyHistogram& run, const char* threadName)
+        {
+            const TimePoint start = Clock::now();
+            wait.record(start - b.queuedAt);
+
+            try
+            {
+                std::invoke(b.task);
+            }
+            catch(const std::exception& e)
+            {
+                logging::GALogger::e("Failed to run block on %s thread: %s", threadName, e.what());
+            }
+
+            run.record(Clock::now() - start);
+            b.task.reset();
+        }
+
+        void GAThreading::queueBlock(Task&& b, GATaskInfo const& info)
+        {
+            if(reserveRoom(b, info))
+            {
+                pushBlock({std::move(b), Clock::now()}, info);
+            }
+        }
+
+        bool GAThreading::reserveRoom(Task& b, GATaskInfo const& info)
+        {
+            // makeRoom() takes the slot itself when it finds room, nobody else can get it in between
+            if(!tryReserveSlot() && !makeRoom(b, info))
+            {
+                return false;
+            }
+
+            const std::size_t depth = _pendingBlocks.load(std::memory_order_relaxed);
+
+            std::size_t maxDepth = _maxPendingSeen.load(std::memory_order_relaxed);
+            while(depth > maxDepth && !_maxPendingSeen.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed))
+            {
+            }
+
+            return true;
+        }
+
+        bool GAThreading::tryReserveSlot()
+        {
+            const std::size_t maxDepth = _maxPendingBlocks.load(std::memory_order_relaxed);
+
+            std::size_t depth = _pendingBlocks.load(std::memory_order_relaxed);
+            while(depth < maxDepth)
+            {
+                if(_pendingBlocks.compare_exchange_weak(depth, depth + 1))
                 {
-                    std::invoke(b);
+                    return true;
                 }
-                catch(const std::exception& e)
+            }
+
+            return false;
+        }
+
+        bool GAThreading::isSearchablePolicy() const
+        {
+            const int policy = _overflowPolicy.load(std::memory_order_relaxed);
+            return policy == QueueDropOldestLowPriority || policy == QueueCoalesce;
+        }
+
+        void GAThreading::pushBlock(QueuedBlock&& block, GATaskInfo const& info)
+        {
+            bool queued = false;
+
+            // the ring buffer can't be searched, the policies which look at the queued blocks get all of them in the locked queue
+            if(!_isOverflowing.load(std::memory_order_acquire) && !isSearchablePolicy())
+            {
+                queued = _blocks.tryPush(std::move(block));
+            }
+
+            if(!queued)
+            {
+                // ring buffer is full (or already overflowing, or has to be searchable), fall back to the locked queue
+                std::lock_guard<std::mutex> guard(_overflowMutex);
+                _overflowBlocks.push_back({std::move(block), info});
+                _isOverflowing.store(true, std::memory_order_release);
+            }
+
+            // pairs with the fence in work(): either we see the worker sleeping or it sees the new block
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(_isSleeping.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> guard(_wakeMutex);
+                _hasWork.notify_one();
+            }
+        }
+
+        bool GAThreading::makeRoom(Task& b, GATaskInfo const& info)
+        {
+            const EGAQueueOverflowPolicy policy = static_cast<EGAQueueOverflowPolicy>(_overflowPolicy.load(std::memory_order_relaxed));
+
+            if(policy == QueueCoalesce && info.coalesceKey != 0)
+            {
+                // blocks queued before the policy was set may still be in the ring buffer, those are not replaced
+                std::lock_guard<std::mutex> guard(_overflowMutex);
+                for(auto it = _overflowBlocks.rbegin(); it != _overflowBlocks.rend(); ++it)
+                {
+                    if(it->info.coalesceKey == info.coalesceKey)
+                    {
+                        it->block.task = std::move(b);
+                        it->info       = info;
+                        return false;
+                    }
+                }
+            }
+
+            if(info.priority == EGATaskPriority::High)
+            {
+                _pendingBlocks.fetch_add(1);
+                return true;
+            }
+
+            switch(policy)
+            {
+                case QueueBlockWithTimeout:
+                {
+                    if(waitForRoom())
+                    {
+                        return true;
+                    }
+                    break;
+                }
+
+                case QueueDropOldestLowPriority:
+                {
+                    std::lock_guard<std::mutex> guard(_overflowMutex);
+
+                    auto it = std::find_if(_overflowBlocks.begin(), _overflowBlocks.end(),
+                        [](OverflowBlock const& block) { return block.info.priority == EGATaskPriority::Low; });
+
+                    if(it != _overflowBlocks.end())
+                    {
+                        // the new block takes over one of the dropped block's slots
+                        recordDrop(it->info.category);
+                        _pendingBlocks.fetch_sub(it->block.weight - 1);
+                        _overflowBlocks.erase(it);
+                        return true;
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+
+            recordDrop(info.category);
+            return false;
+        }
+
+        bool GAThreading::waitForRoom()
+        {
+            // the ga thread can't wait for itself
+            if(isWorkerThread())
+            {
+                return false;
+            }
+
+            const std::chrono::milliseconds timeout(_blockTimeoutMs.load(std::memory_order_relaxed));
+
+            std::unique_lock<std::mutex> guard(_roomMutex);
+            _waitingProducers.fetch_add(1);
+
+            // every woken producer competes for the freed slots, the ones which don't get one keep waiting
+            bool reserved = false;
+            _hasRoom.wait_for(guard, timeout,
+                [this, &reserved]()
                 {
-                    logging::GALogger::e("Failed to run block on ga thread: %s", e.what());
+                    if(_endThread)
+                    {
+                        return true;
+                    }
+
+                    reserved = tryReserveSlot();
+                    return reserved;
                 }
+            );
+
+            _waitingProducers.fetch_sub(1);
+            return reserved;
+        }
+
+        void GAThreading::onBlockTaken(std::size_t weight)
+        {
+            // pairs with waitForRoom(): either the producer sees the new count or we see it waiting
+            _pendingBlocks.fetch_sub(weight);
+            if(_waitingProducers.load() > 0)
+            {
+                std::lock_guard<std::mutex> guard(_roomMutex);
+                _hasRoom.notify_all();
             }
         }
 
-        void GAThreading::queueBlock(Block&& b)
+        void GAThreading::recordDrop(const char* category)
         {
-            std::unique_lock<std::mutex> guard(_blockMutex);
-            _blocks.push(std::forward<Block>(b));
+            const std::string key = category ? category : UNKNOWN_VALUE;
+
+            std::lock_guard<std::mutex> guard(_dropMutex);
+            const std::int64_t count = ++_droppedTasks[key];
+
+            // don't flood the log during an event storm
+            if((count & (count - 1)) == 0)
+            {
+                logging::GALogger::w("Event queue is full, dropped %" PRId64 " %s event(s) so far", count, key.c_str());
+            }
+        }
+
+        bool GAThreading::getNextBlock(QueuedBlock& out)
+        {
+            if(_blocks.tryPop(out))
+            {
+                onBlockTaken(out.weight);
+                return true;
+            }
+
+            if(_isOverflowing.load(std::memory_order_acquire))
+            {
+                {
+                    std::lock_guard<std::mutex> guard(_overflowMutex);
+                    if(!_overflowBlocks.empty())
+                    {
+                        out = std::move(_overflowBlocks.front().block);
+                        _overflowBlocks.pop_front();
+                    }
+
+                    // only switch producers back to the ring buffer once both queues are drained in order
+                    if(_overflowBlocks.empty())
+                    {
+                        _isOverflowing.store(false, std::memory_order_release);
+                    }
+                }
+
+                if(out.task)
+                {
+                    onBlockTaken(out.weight);
+                    return true;
+                }
+            }
+
+            return false;
         }
 
-        GAThreading::Block GAThreading::getNextBlock()
+        bool GAThreading::hasBlocks() const
         {
-            std::unique_lock<std::mutex> guard(_blockMutex);
-            Block b = _blocks.front();
-            _blocks.pop();
-            return b;
+            return !_blocks.empty() || _isOverflowing.load(std::memory_order_acquire);
         }
 
-        void GAThreading::updateTasks(bool force)
+        void GAThreading::wakeUp()
         {
-            std::unique_lock<std::mutex> guard(_taskMutex);
-            for(auto& task : _tasks)
-            {   
-                task.tick(force);
+            {
+                std::unique_lock<std::mutex> guard(_wakeMutex);
+                _wakeUp = true;
             }
+
+            _hasWork.notify_one();
+        }
+
+        void GAThreading::pushTimerEntry(TimerId id, ScheduledTask const& task)
+        {
+            _timerHeap.push_back({task.deadline, id, task.generation});
+            std::push_heap(_timerHeap.begin(), _timerHeap.end(), std::greater<TimerEntry>());
+        }
+
+        void GAThreading::compactTimerHeap()
+        {
+            // cancelled or rescheduled timers leave stale entries behind, rebuild once they dominate the heap
+            if(_timerHeap.size() <= 2 * _tasks.size() + 16)
+            {
+                return;
+            }
+
+            _timerHeap.clear();
+            for(auto const& [id, task] : _tasks)
+            {
+                _timerHeap.push_back({task.deadline, id, task.generation});
+            }
+
+            std::make_heap(_timerHeap.begin(), _timerHeap.end(), std::greater<TimerEntry>());
+        }
+
+        GAThreading::TimePoint GAThreading::updateTasks(bool force)
+        {
+            std::vector<std::shared_ptr<Block>> dueTasks;
+            TimePoint nextCall = TimePoint::max();
+
+            {
+                std::unique_lock<std::mutex> guard(_taskMutex);
+
+                const TimePoint now = Clock::now();
+
+                if(force)
+                {
+                    for(auto const& [id, task] : _tasks)
+                    {
+                        dueTasks.push_back(task.task);
+                    }
+                }
+                else
+                {
+                    // run everything due within the slack window so close deadlines share a single wake-up
+                    const TimePoint runUntil = now + TIMER_SLACK;
+                    std::vector<TimerId> fired;
+
+                    while(!_timerHeap.empty() && _timerHeap.front().deadline <= runUntil)
+                    {
+                        std::pop_heap(_timerHeap.begin(), _timerHeap.end(), std::greater<TimerEntry>());
+                        const TimerEntry entry = _timerHeap.back();
+                        _timerHeap.pop_back();
+
+                        auto it = _tasks.find(entry.id);
+                        if(it == _tasks.end() || it->second.generation != entry.generation)
+                        {
+                            continue;
+                        }
+
+                        dueTasks.push_back(it->second.task);
+                        fired.push_back(entry.id);
+                    }
+
+                    // re-arm after the loop, otherwise timers shorter than the slack would never leave it
+                    for(TimerId id : fired)
+                    {
+                        ScheduledTask& task = _tasks.at(id);
+                        task.deadline = now + task.frequency;
+                        pushTimerEntry(id, task);
+                    }
+                }
+
+                while(!_timerHeap.empty())
+                {
+                    const TimerEntry& top = _timerHeap.front();
+                    auto it = _tasks.find(top.id);
+                    if(it != _tasks.end() && it->second.generation == top.generation)
+                    {
+                        nextCall = top.deadline;
+                        break;
+                    }
+
+                    std::pop_heap(_timerHeap.begin(), _timerHeap.end(), std::greater<TimerEntry>());
+                    _timerHeap.pop_back();
+                }
+            }
+
+            // run outside of the lock so tasks can schedule or cancel timers themselves
+            for(auto const& task : dueTasks)
+            {
+                const TimePoint start = Clock::now();
+
+                try
+                {
+                    std::invoke(*task);
+                }
+                catch(const std::exception& e)
+                {
+                    logging::GALogger::e("Failed to run scheduled task on ga thread: %s", e.what());
+                }
+
+                _timerRun.record(Clock::now() - start);
+            }
+
+            return nextCall;
         }
 
         void GAThreading::work()
         {
+            _workerId = std::this_thread::get_id();
+            applyThreadSettings(false);
+
+            TimePoint stagingDeadline = TimePoint::max();
+
             while(!_endThread)
             {
                 runBlocks();
-                updateTasks();
 
-                std::this_thread::sleep_for(THREAD_TASK_FREQUENCY);
+                // give the other threads up to the max delay to fill their staging buffers before taking them
+                if(_hasStagedBlocks)
+                {
+                    const TimePoint now = Clock::now();
+                    if(stagingDeadline == TimePoint::max())
+                    {
+                        stagingDeadline = now + std::chrono::milliseconds(_stagingMaxDelayMs.load(std::memory_order_relaxed));
+                    }
+
+                    if(now >= stagingDeadline)
+                    {
+                        drainStagingBuffers();
+                        stagingDeadline = TimePoint::max();
+                        runBlocks();
+                    }
+                }
+
+                const TimePoint nextCall = std::min(updateTasks(), stagingDeadline);
+
+                // sleep until there is something to do: a new block, a new task or the next task being due
+                std::unique_lock<std::mutex> guard(_wakeMutex);
+
+                _isSleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                auto hasWork = [this, &stagingDeadline]()
+                {
+                    return _endThread || _wakeUp || hasBlocks() || (_hasStagedBlocks && stagingDeadline == TimePoint::max());
+                };
+
+                if(nextCall == TimePoint::max())
+                {
+                    _hasWork.wait(guard, hasWork);
+                }
+                else
+                {
+                    _hasWork.wait_until(guard, nextCall, hasWork);
+                }
+
+                _isSleeping.store(false, std::memory_order_relaxed);
+                _wakeUp = false;
+            }
+        }
+
+        void GAThreading::performTaskOnGAThread(Task b, GATaskInfo const& info)
+        {
+            GAThreading& instance = getInstance();
+
+            instance.ensureStarted();
+            instance.submitBlock(std::move(b), info);
+        }
+
+        void GAThreading::submitBlock(Task&& b, GATaskInfo const& info)
+        {
+            // only set once this thread has staged something, it stays registered until the thread exits
+            thread_local std::shared_ptr<StagingBuffer> localBuffer;
+
+            // a staged batch is queued as a single block, which the policies that search the queue couldn't drop events from
+            const bool stage = info.priority != EGATaskPriority::High && _isStagingEnabled.load(std::memory_order_relaxed) && !isSearchablePolicy();
+
+            if(!localBuffer)
+            {
+                if(!stage)
+                {
+                    queueBlock(std::move(b), info);
+                    return;
+                }
+
+                localBuffer = std::make_shared<StagingBuffer>();
+                localBuffer->blocks.reserve(_stagingBatchSize.load(std::memory_order_relaxed));
+
+                std::lock_guard<std::mutex> guard(_stagingMutex);
+                _stagingBuffers.push_back(localBuffer);
+            }
+
+            if(!stage)
+            {
+                // whatever this thread staged has to run first. Queueing the new block can wait for room, which
+                // needs the ga thread, and the ga thread needs the buffer to drain it, so it is released before that
+                {
+                    std::lock_guard<std::mutex> guard(localBuffer->mutex);
+                    flushStagingBuffer(*localBuffer);
+                }
+
+                queueBlock(std::move(b), info);
+                return;
+            }
+
+            // staged blocks count against the queue capacity and go through the overflow policy one by one
+            if(!reserveRoom(b, info))
+            {
+                return;
+            }
+
+            // the ga thread only takes this lock when draining, so it is hardly ever contended
+            std::unique_lock<std::mutex> guard(localBuffer->mutex);
+
+            const bool wasEmpty = localBuffer->blocks.empty();
+            localBuffer->blocks.push_back(std::move(b));
+
+            if(localBuffer->blocks.size() >= _stagingBatchSize.load(std::memory_order_relaxed))
+            {
+                flushStagingBuffer(*localBuffer);
+                return;
+            }
+
+            guard.unlock();
+
+            if(wasEmpty)
+            {
+                signalStagedBlocks();
+            }
+        }
+
+        void GAThreading::flushStagingBuffer(StagingBuffer& buffer)
+        {
+            if(buffer.blocks.empty())
+            {
+                return;
+            }
+
+            std::vector<Task> blocks;
+            blocks.swap(buffer.blocks);
+            buffer.blocks.reserve(_stagingBatchSize.load(std::memory_order_relaxed));
+
+            const std::size_t count = blocks.size();
+
+            // room for every block was reserved when it was staged, so the batch is queued without waiting
+            Task batch(
+                [blocks = std::move(blocks)]() mutable
+                {
+                    for(Task& block : blocks)
+                    {
+                        try
+                        {
+                            std::invoke(block);
+                        }
+                        catch(const std::exception& e)
+                        {
+                            logging::GALogger::e("Failed to run block on ga thread: %s", e.what());
+                        }
+
+                        block.reset();
+                    }
+                }
+            );
+
+            pushBlock({std::move(batch), Clock::now(), count}, {});
+        }
+
+        void GAThreading::drainStagingBuffers()
+        {
+            _hasStagedBlocks = false;
+
+            std::lock_guard<std::mutex> guard(_stagingMutex);
+            for(auto it = _stagingBuffers.begin(); it != _stagingBuffers.end();)
+            {
+                {
+                    std::lock_guard<std::mutex> bufferGuard((*it)->mutex);
+                    flushStagingBuffer(**it);
+                }
+
+                // the thread owning it has exited and nothing is left in it
+                if(it->use_count() == 1)
+                {
+                    it = _stagingBuffers.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        void GAThreading::signalStagedBlocks()
+        {
+            // only the first staged block after a drain touches the shared flag
+            if(_hasStagedBlocks.load(std::memory_order_relaxed))
+            {
+                return;
             }
+
+            _hasStagedBlocks = true;
+
+            // pairs with the fence in work(), same as for queued blocks
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(_isSleeping.load(std::memory_order_relaxed))
+            {
+                wakeUp();
+            }
+        }
+
+        void GAThreading::configureStaging(bool enabled, std::size_t batchSize, std::chrono::milliseconds maxDelay)
+        {
+            GAThreading& instance = getInstance();
+
+            instance._stagingBatchSize.store(std::max<std::size_t>(batchSize, 1));
+            instance._stagingMaxDelayMs.store(std::max<std::int64_t>(maxDelay.count(), 0));
+            instance._isStagingEnabled.store(enabled);
         }
 
-        void GAThreading::performTaskOnGAThread(Block b)
+        void GAThreading::drainStagedBlocks()
         {
-            getInstance().queueBlock(std::move(b));
+            getInstance().drainStagingBuffers();
+        }
+
+        std::future<void> GAThreading::performTaskOnGAThreadWithFuture(Task b, GATaskInfo const& info)
+        {
+            // dropping the block destroys the promise without a value, which breaks the future
+            auto promise = std::make_shared<std::promise<void>>();
+            std::future<void> future = promise->get_future();
+
+            performTaskOnGAThread(
+                [promise, block = std::move(b)]() mutable
+                {
+                    try
+                    {
+                        std::invoke(block);
+                        promise->set_value();
+                    }
+                    catch(...)
+                    {
+                        promise->set_exception(std::current_exception());
+                    }
+                },
+                info
+            );
+
+            return future;
+        }
+
+        json GAThreading::getStats()
+        {
+            GAThreading& instance = getInstance();
+
+            const double elapsed = std::chrono::duration<double>(Clock::now() - instance._statsStart).count();
+            const std::uint64_t tasks = instance._blockRun.count() + instance._timerRun.count() + instance._ioRun.count();
+
+            // the longest a single block or timer kept the ga thread from anything else
+            const std::chrono::nanoseconds maxStall = std::max(instance._blockRun.max(), instance._timerRun.max());
+
+            json stats;
+            stats["queue_depth"]      = instance._pendingBlocks.load();
+            stats["queue_depth_max"]  = instance._maxPendingSeen.load();
+            stats["dropped"]          = getDroppedTaskCount("");
+            stats["tasks_per_second"] = elapsed > 0.0 ? static_cast<double>(tasks) / elapsed : 0.0;
+            stats["max_stall_ms"]     = std::chrono::duration<double, std::milli>(maxStall).count();
+            stats["block_wait"]       = instance._blockWait.toJson();
+            stats["block_run"]        = instance._blockRun.toJson();
+            stats["timer_run"]        = instance._timerRun.toJson();
+            stats["io_wait"]          = instance._ioWait.toJson();
+            stats["io_run"]           = instance._ioRun.toJson();
+
+            return stats;
+        }
+
+        void GALatencyHistogram::record(std::chrono::nanoseconds duration)
+        {
+            const std::uint64_t ns = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+
+            std::size_t bucket = 0;
+            for(std::uint64_t us = ns / 1000; us > 0 && bucket < BucketCount - 1; us >>= 1)
+            {
+                ++bucket;
+            }
+
+            _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+            std::uint64_t maxNs = _maxNs.load(std::memory_order_relaxed);
+            while(ns > maxNs && !_maxNs.compare_exchange_weak(maxNs, ns, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        std::uint64_t GALatencyHistogram::count() const
+        {
+            return _count.load(std::memory_order_relaxed);
+        }
+
+        std::chrono::nanoseconds GALatencyHistogram::max() const
+        {
+            return std::chrono::nanoseconds(_maxNs.load(std::memory_order_relaxed));
+        }
+
+        json GALatencyHistogram::toJson() const
+        {
+            std::array<std::uint64_t, BucketCount> buckets;
+            std::uint64_t total = 0;
+
+            for(std::size_t i = 0; i < BucketCount; ++i)
+            {
+                buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+                total += buckets[i];
+            }
+
+            // upper bound of the bucket holding the given fraction of samples
+            auto percentile = [&buckets, total](double fraction) -> std::uint64_t
+            {
+                const std::uint64_t target = static_cast<std::uint64_t>(std::ceil(total * fraction));
+                std::uint64_t seen = 0;
+
+                for(std::size_t i = 0; i < BucketCount; ++i)
+                {
+                    seen += buckets[i];
+                    if(seen >= target && seen > 0)
+                    {
+                        return std::uint64_t(1) << i;
+                    }
+                }
+
+                return 0;
+            };
+
+            const std::uint64_t count = _count.load(std::memory_order_relaxed);
+
+            json out;
+            out["count"]  = count;
+            out["avg_us"] = count > 0 ? _totalNs.load(std::memory_order_relaxed) / count / 1000 : 0;
+            out["max_us"] = _maxNs.load(std::memory_order_relaxed) / 1000;
+            out["p50_us"] = percentile(0.5);
+            out["p99_us"] = percentile(0.99);
+
+            return out;
+        }
+
+        void GAThreading::setThreadAffinity(std::vector<int> const& cpus)
+        {
+            getInstance().updateThreadSettings([&cpus](GAThreadSettings& settings) { settings.cpuAffinity = cpus; });
+        }
+
+        void GAThreading::setThreadScheduling(EGAThreadSchedulingPolicy policy, int niceValue)
+        {
+            getInstance().updateThreadSettings(
+                [policy, niceValue](GAThreadSettings& settings)
+                {
+                    settings.policy    = policy;
+                    settings.niceValue = niceValue;
+                }
+            );
+        }
+
+        void GAThreading::setThreadName(std::string const& name)
+        {
+            getInstance().updateThreadSettings([&name](GAThreadSettings& settings) { settings.name = name; });
+        }
+
+        void GAThreading::updateThreadSettings(std::function<void(GAThreadSettings&)> const& change)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_threadSettingsMutex);
+                change(_threadSettings);
+            }
+
+            if(_isExternalPump)
+            {
+                logging::GALogger::w("Thread settings are ignored in external pump mode");
+                return;
+            }
+
+            // threads which are not started yet pick the settings up when they start
+            if(_isStarted)
+            {
+                queueBlock([this]() { applyThreadSettings(false); });
+                queueIOBlock([this]() { applyThreadSettings(true); });
+            }
+        }
+
+        void GAThreading::applyThreadSettings(bool isIOThread)
+        {
+            GAThreadSettings settings;
+            {
+                std::lock_guard<std::mutex> guard(_threadSettingsMutex);
+                settings = _threadSettings;
+            }
+
+            if(isIOThread && !settings.name.empty())
+            {
+                settings.name = settings.name.substr(0, 12) + "-io";
+            }
+
+            if(GAPlatform* platform = device::GADevice::getPlatform())
+            {
+                platform->applyThreadSettings(settings);
+            }
+        }
+
+        bool GAThreading::isGAThread()
+        {
+            return getInstance().isWorkerThread();
+        }
+
+        void GAThreading::configureQueue(std::size_t capacity, EGAQueueOverflowPolicy policy, std::chrono::milliseconds blockTimeout)
+        {
+            GAThreading& instance = getInstance();
+
+            instance._maxPendingBlocks.store(std::max<std::size_t>(capacity, 1));
+            instance._overflowPolicy.store(policy);
+            instance._blockTimeoutMs.store(std::max<std::int64_t>(blockTimeout.count(), 0));
+
+            // a larger capacity might let waiting producers through
+            std::lock_guard<std::mutex> guard(instance._roomMutex);
+            instance._hasRoom.notify_all();
+        }
+
+        std::int64_t GAThreading::getDroppedTaskCount(std::string const& category)
+        {
+            GAThreading& instance = getInstance();
+            std::lock_guard<std::mutex> guard(instance._dropMutex);
+
+            if(!category.empty())
+            {
+                auto it = instance._droppedTasks.find(category);
+                return it != instance._droppedTasks.end() ? it->second : 0;
+            }
+
+            std::int64_t total = 0;
+            for(auto const& [name, count] : instance._droppedTasks)
+            {
+                total += count;
+            }
+
+            return total;
+        }
+
+        void GAThreading::performTaskOnIOThread(Task b)
+        {
+            GAThreading& instance = getInstance();
+
+            instance.ensureStarted();
+            instance.queueIOBlock(std::move(b));
         }
 
         void GAThreading::endThread()
         {
-            getInstance()._endThread = true;
+            GAThreading& instance = getInstance();
+            {
+                std::unique_lock<std::mutex> guard(instance._wakeMutex);
+                instance._endThread = true;
+            }
+
+            instance._hasWork.notify_all();
         }
 
         bool GAThreading::isThreadFinished()
@@ -126,45 +1093,83 @@ namespace gameanalytics
         }
 
         GAThreading::ScheduledTask::ScheduledTask(std::chrono::milliseconds freq, Block&& task):
-            task(std::forward<Block>(task)),
-            frequency(freq)
+            task(std::make_shared<Block>(std::move(task))),
+            frequency(freq),
+            deadline(Clock::now() + freq)
         {
-            _lastCall = std::chrono::high_resolution_clock::now();
         }
 
-        void GAThreading::scheduleTask(std::chrono::milliseconds freq, Block&& task)
+        GAThreading::TimerId GAThreading::scheduleTask(std::chrono::milliseconds freq, Block&& task)
         {
-            std::unique_lock<std::mutex> guard(_taskMutex);
-            _tasks.push_back(ScheduledTask(freq, std::forward<Block>(task)));
+            TimerId id = InvalidTimerId;
+
+            {
+                std::unique_lock<std::mutex> guard(_taskMutex);
+
+                id = ++_lastTimerId;
+                auto it = _tasks.emplace(id, ScheduledTask(freq, std::move(task))).first;
+                pushTimerEntry(id, it->second);
+            }
+
+            // the worker might be sleeping past the new task's first deadline
+            wakeUp();
+
+            return id;
         }
 
-        void GAThreading::scheduleTimer(std::chrono::milliseconds freq, Block task)
+        bool GAThreading::removeTask(TimerId id)
         {
-            return getInstance().scheduleTask(freq, std::move(task));
+            std::unique_lock<std::mutex> guard(_taskMutex);
+
+            if(_tasks.erase(id) == 0)
+            {
+                return false;
+            }
+
+            compactTimerHeap();
+            return true;
         }
 
-        bool GAThreading::ScheduledTask::tick(bool force)
+        bool GAThreading::rescheduleTask(TimerId id, std::chrono::milliseconds freq)
         {
-            auto now = std::chrono::high_resolution_clock::now();
-            if(((now - _lastCall) >= frequency) || force)
             {
-                _lastCall = now;
-                
-                try
-                {
-                    std::invoke(task);
-                }
-                catch(const std::exception& e)
+                std::unique_lock<std::mutex> guard(_taskMutex);
+
+                auto it = _tasks.find(id);
+                if(it == _tasks.end())
                 {
-                    logging::GALogger::e("Failed to run scheduled task on ga thread: %s", e.what());
                     return false;
                 }
 
-                return true;
+                ScheduledTask& task = it->second;
+                task.frequency = freq;
+                task.deadline  = Clock::now() + freq;
+                ++task.generation;
+
+                pushTimerEntry(id, task);
+                compactTimerHeap();
             }
 
-            return false;
+            wakeUp();
+            return true;
+        }
+
+        GAThreading::TimerId GAThreading::scheduleTimer(std::chrono::milliseconds freq, Block task)
+        {
+            GAThreading& instance = getInstance();
+
+            instance.ensureStarted();
+            return instance.scheduleTask(freq, std::move(task));
         }
 
+        bool GAThreading::cancelTimer(TimerId id)
+        {
+            return getInstance().removeTask(id);
+        }
+
+        bool GAThreading::rescheduleTimer(TimerId id, std::chrono::milliseconds freq)
+        {
+            return getInstance().rescheduleTask(id, freq);
+        }
     }
 }
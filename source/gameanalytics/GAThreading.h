@@ -13,69 +13,562 @@
 #include <memory>
 #include <future>
 #include <mutex>
-#include <queue>
+#include <condition_variable>
+#include <deque>
 #include <algorithm>
+#include <type_traits>
+#include <new>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <array>
 
 #include "GACommon.h"
+#include "Platform/GAPlatform.h"
 
 namespace gameanalytics
 {
     namespace threading
     {
+        // Move-only callable which keeps small closures inline instead of allocating them on the heap.
+        // Closures that don't fit (or can't be moved without throwing) fall back to a heap allocation.
+        class GATask
+        {
+         public:
+
+            static constexpr std::size_t InlineSize = 192;
+
+            GATask() = default;
+
+            template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, GATask>>>
+            GATask(F&& f)
+            {
+                using Fn = std::decay_t<F>;
+
+                if constexpr (fitsInline<Fn>())
+                {
+                    new (_storage) Fn(std::forward<F>(f));
+                    _ops = &inlineOps<Fn>;
+                }
+                else
+                {
+                    Fn* ptr = new Fn(std::forward<F>(f));
+                    std::memcpy(_storage, &ptr, sizeof(ptr));
+                    _ops = &heapOps<Fn>;
+                }
+            }
+
+            GATask(GATask&& other) noexcept
+            {
+                moveFrom(other);
+            }
+
+            GATask& operator=(GATask&& other) noexcept
+            {
+                if(this != &other)
+                {
+                    reset();
+                    moveFrom(other);
+                }
+
+                return *this;
+            }
+
+            GATask(const GATask&) = delete;
+            GATask& operator=(const GATask&) = delete;
+
+            ~GATask()
+            {
+                reset();
+            }
+
+            explicit operator bool() const
+            {
+                return _ops != nullptr;
+            }
+
+            void operator()()
+            {
+                _ops->invoke(_storage);
+            }
+
+            void reset()
+            {
+                if(_ops)
+                {
+                    _ops->destroy(_storage);
+                    _ops = nullptr;
+                }
+            }
+
+         private:
+
+            struct Ops
+            {
+                void (*invoke)(void* storage);
+                void (*move)(void* to, void* from);
+                void (*destroy)(void* storage);
+            };
+
+            template<typename Fn>
+            static constexpr bool fitsInline()
+            {
+                return sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Fn>;
+            }
+
+            template<typename Fn>
+            static inline const Ops inlineOps =
+            {
+                [](void* s)          { (*std::launder(reinterpret_cast<Fn*>(s)))(); },
+                [](void* to, void* from)
+                {
+                    Fn* src = std::launder(reinterpret_cast<Fn*>(from));
+                    new (to) Fn(std::move(*src));
+                    src->~Fn();
+                },
+                [](void* s)          { std::launder(reinterpret_cast<Fn*>(s))->~Fn(); }
+            };
+
+            template<typename Fn>
+            static Fn* heapPtr(void* s)
+            {
+                Fn* ptr = nullptr;
+                std::memcpy(&ptr, s, sizeof(ptr));
+                return ptr;
+            }
+
+            template<typename Fn>
+            static inline const Ops heapOps =
+            {
+                [](void* s)          { (*heapPtr<Fn>(s))(); },
+                [](void* to, void* from) { std::memcpy(to, from, sizeof(Fn*)); },
+                [](void* s)          { delete heapPtr<Fn>(s); }
+            };
+
+            void moveFrom(GATask& other)
+            {
+                if(other._ops)
+                {
+                    other._ops->move(_storage, other._storage);
+                    _ops = other._ops;
+                    other._ops = nullptr;
+                }
+            }
+
+            alignas(std::max_align_t) unsigned char _storage[InlineSize];
+            const Ops* _ops = nullptr;
+        };
+
+        // Bounded multi-producer/single-consumer ring buffer (based on Dmitry Vyukov's bounded queue).
+        // Producers claim a slot with a single CAS and never block; tryPush fails when the queue is full.
+        template<typename T>
+        class GAMpscQueue
+        {
+         public:
+
+            explicit GAMpscQueue(std::size_t capacity):
+                _cells(new Cell[roundUpToPowerOfTwo(capacity)]),
+                _mask(roundUpToPowerOfTwo(capacity) - 1)
+            {
+                for(std::size_t i = 0; i <= _mask; ++i)
+                {
+                    _cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            GAMpscQueue(const GAMpscQueue&) = delete;
+            GAMpscQueue& operator=(const GAMpscQueue&) = delete;
+
+            std::size_t capacity() const
+            {
+                return _mask + 1;
+            }
+
+            bool tryPush(T&& value)
+            {
+                std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+                Cell* cell = nullptr;
+
+                while(true)
+                {
+                    cell = &_cells[pos & _mask];
+
+                    const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                    const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+                    if(diff == 0)
+                    {
+                        if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if(diff < 0)
+                    {
+                        // full
+                        return false;
+                    }
+                    else
+                    {
+                        pos = _enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                cell->data = std::move(value);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            // must only be called from the consumer thread
+            bool tryPop(T& out)
+            {
+                const std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+                Cell* cell = &_cells[pos & _mask];
+
+                const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                if(seq != pos + 1)
+                {
+                    // empty, or the producer which claimed the slot hasn't published it yet
+                    return false;
+                }
+
+                _dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+                out = std::move(cell->data);
+                cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            bool empty() const
+            {
+                const std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+                return _cells[pos & _mask].sequence.load(std::memory_order_acquire) != pos + 1;
+            }
+
+         private:
+
+            static std::size_t roundUpToPowerOfTwo(std::size_t v)
+            {
+                std::size_t p = 2;
+                while(p < v)
+                {
+                    p <<= 1;
+                }
+
+                return p;
+            }
+
+            struct Cell
+            {
+                std::atomic<std::size_t> sequence{0};
+                T data;
+            };
+
+            std::unique_ptr<Cell[]> _cells;
+            const std::size_t       _mask;
+
+            // keep producer and consumer positions on separate cache lines
+            alignas(64) std::atomic<std::size_t> _enqueuePos{0};
+            alignas(64) std::atomic<std::size_t> _dequeuePos{0};
+        };
+
+        // lock-free latency histogram with power of two buckets in microseconds, cheap enough to record every task
+        class GALatencyHistogram
+        {
+         public:
+
+            static constexpr std::size_t BucketCount = 24;  // bucket i holds samples below 2^i us, the last one everything slower
+
+            void record(std::chrono::nanoseconds duration);
+
+            std::uint64_t            count() const;
+            std::chrono::nanoseconds max() const;
+
+            json toJson() const;
+
+         private:
+
+            std::array<std::atomic<std::uint64_t>, BucketCount> _buckets{};
+            std::atomic<std::uint64_t> _count{0};
+            std::atomic<std::uint64_t> _totalNs{0};
+            std::atomic<std::uint64_t> _maxNs{0};
+        };
+
+        enum class EGATaskPriority
+        {
+            Low,
+            Normal,
+            High    // never dropped, may exceed the queue capacity
+        };
+
+        // describes a queued block to the overflow policy
+        struct GATaskInfo
+        {
+            const char*     category    = nullptr;
+            EGATaskPriority priority    = EGATaskPriority::High;
+            std::uint64_t   coalesceKey = 0;    // blocks with the same non zero key overwrite the same setting
+        };
+
         class GAThreading
         {
             friend class state::GAState;
 
          public:
 
-            using Block = std::function<void()>;
+            using Block   = std::function<void()>;
+            using Task    = GATask;
+            using TimerId = std::uint64_t;
+
+            static constexpr TimerId InvalidTimerId = 0;
+
+            static void performTaskOnGAThread(Task taskBlock, GATaskInfo const& info = {});
+
+            // the future becomes ready once the block ran, it holds a broken_promise error if the block was dropped
+            static std::future<void> performTaskOnGAThreadWithFuture(Task taskBlock, GATaskInfo const& info = {});
 
-            static void performTaskOnGAThread(Block taskBlock);
+            // true on the ga thread, or on the thread currently calling pump()
+            static bool isGAThread();
+
+            // queue depth, wait and run time histograms per lane and throughput since the sdk started
+            static json getStats();
+
+            // opt-in: blocks which may be dropped (events) are collected in a buffer per calling thread and handed to
+            // the ga thread in bulk, once batchSize blocks are staged or at the latest after maxDelay
+            static void configureStaging(bool enabled, std::size_t batchSize, std::chrono::milliseconds maxDelay);
+
+            // queues what other threads have staged so far, needs to be called on the ga thread
+            static void drainStagedBlocks();
+
+            // placement of the sdk's own threads, applied right away to running threads. Ignored in external pump mode
+            static void setThreadAffinity(std::vector<int> const& cpus);
+            static void setThreadScheduling(EGAThreadSchedulingPolicy policy, int niceValue);
+            static void setThreadName(std::string const& name);
+
+            static void configureQueue(std::size_t capacity, EGAQueueOverflowPolicy policy, std::chrono::milliseconds blockTimeout);
+
+            // number of blocks dropped by the overflow policy, all categories if category is empty
+            static std::int64_t getDroppedTaskCount(std::string const& category);
+
+            // network requests run on their own thread so a slow collector never holds up the ga thread
+            static void performTaskOnIOThread(Task taskBlock);
 
             static void endThread();
 
             static bool isThreadFinished();
 
-            static void scheduleTimer(std::chrono::milliseconds freq, Block task);
-            
+            // runs task every freq milliseconds on the ga thread, the returned id can be used to cancel or reschedule it
+            static TimerId scheduleTimer(std::chrono::milliseconds freq, Block task);
+
+            static bool cancelTimer(TimerId id);
+
+            // changes the frequency of a timer, its next call will be freq milliseconds from now
+            static bool rescheduleTimer(TimerId id, std::chrono::milliseconds freq);
+
             static void flushTasks();
 
+            // no internal threads are started, the host runs the queued work by calling pump().
+            // needs to be set before the first block is queued
+            static bool setExternalPump(bool enabled);
+            static bool isExternalPump();
+
+            // runs queued blocks, due timers and pending uploads until there is nothing left or the budget is spent.
+            // uploads block until their request finishes so a single one can run past the budget
+            static void pump(std::chrono::milliseconds timeBudget);
+
          private:
 
+            using Clock     = std::chrono::steady_clock;
+            using TimePoint = Clock::time_point;
+
+            static constexpr std::size_t TASK_QUEUE_CAPACITY = 1024;
+
+            static constexpr const char* DEFAULT_THREAD_NAME = "GA-SDK";
+
+            static constexpr std::size_t               DEFAULT_STAGING_BATCH_SIZE = 64;
+            static constexpr std::chrono::milliseconds DEFAULT_STAGING_MAX_DELAY{20};
+
+            struct StagingBuffer
+            {
+                std::mutex        mutex;
+                std::vector<Task> blocks;
+            };
+
+            struct QueuedBlock
+            {
+                Task        task;
+                TimePoint   queuedAt;
+                std::size_t weight = 1;     // calls it counts for against the capacity, a staged batch holds several
+            };
+
+            static constexpr std::size_t               DEFAULT_MAX_QUEUED_TASKS = 8192;
+            static constexpr EGAQueueOverflowPolicy    DEFAULT_OVERFLOW_POLICY  = QueueDropNewest;
+            static constexpr std::chrono::milliseconds DEFAULT_BLOCK_TIMEOUT{100};
+
+            // timers due within this window of each other are run in the same wake-up
+            static constexpr std::chrono::milliseconds TIMER_SLACK{10};
+
             struct ScheduledTask
             {
-                Block task;
+                std::shared_ptr<Block>    task;
                 std::chrono::milliseconds frequency;
+                TimePoint                 deadline;
+                std::uint64_t             generation = 0;
 
                 ScheduledTask(std::chrono::milliseconds frequency, Block&& task);
-                bool tick(bool force = false);
+            };
+
+            // heap entries are not removed on cancel/reschedule, stale ones are skipped by comparing the generation
+            struct TimerEntry
+            {
+                TimePoint     deadline;
+                TimerId       id;
+                std::uint64_t generation;
 
-                private:
-                    std::chrono::high_resolution_clock::time_point _lastCall;
+                bool operator>(TimerEntry const& other) const
+                {
+                    return deadline > other.deadline;
+                }
             };
 
             static GAThreading& getInstance();
-            
+
             GAThreading();
             ~GAThreading();
 
             void work();
-            void queueBlock(Block&& block);
-            void scheduleTask(std::chrono::milliseconds freq, Block&& task);
-            
+            void queueBlock(Task&& block, GATaskInfo const& info = {});
+
+            // counts the block against the capacity, applying the overflow policy if there is no room
+            bool reserveRoom(Task& block, GATaskInfo const& info);
+            void pushBlock(QueuedBlock&& block, GATaskInfo const& info);
+
+            // stages the block if staging applies to it, otherwise queues it after anything this thread staged
+            void submitBlock(Task&& block, GATaskInfo const& info);
+            void flushStagingBuffer(StagingBuffer& buffer);
+            void drainStagingBuffers();
+            void signalStagedBlocks();
+
+            // applies the overflow policy when the queue is full, returns false if the block should not be queued
+            // and true once a slot is reserved for it
+            bool makeRoom(Task& block, GATaskInfo const& info);
+            bool waitForRoom();
+
+            // takes a slot if the queue is below its capacity
+            bool tryReserveSlot();
+
+            // true for the policies which search the queued blocks, they need every block in the locked queue
+            bool isSearchablePolicy() const;
+            void onBlockTaken(std::size_t weight);
+            void recordDrop(const char* category);
+            TimerId scheduleTask(std::chrono::milliseconds freq, Block&& task);
+            bool    removeTask(TimerId id);
+            bool    rescheduleTask(TimerId id, std::chrono::milliseconds freq);
+
+            bool    getNextIOBlock(QueuedBlock& out);
+
             void flush();
 
-            Block getNextBlock();
+            // threads are started on first use so external pump mode can still be configured before that
+            void ensureStarted();
+            void pumpWork(std::chrono::milliseconds timeBudget);
+            bool isWorkerThread() const;
+
+            void updateThreadSettings(std::function<void(GAThreadSettings&)> const& change);
+            void applyThreadSettings(bool isIOThread);
+
+            void ioWork();
+            void queueIOBlock(Task&& block);
+            void endIOThread();
+
+            bool  getNextBlock(QueuedBlock& out);
+            void  runBlock(QueuedBlock& block, GALatencyHistogram& wait, GALatencyHistogram& run, const char* threadName);
+            bool  hasBlocks() const;
             void  runBlocks();
-            void  updateTasks(bool force = false);
-            
-            std::vector<ScheduledTask> _tasks;
-            std::queue<Block> _blocks;
+            void  wakeUp();
+
+            // runs all due tasks and returns the time point of the next one due
+            TimePoint updateTasks(bool force = false);
+
+            void pushTimerEntry(TimerId id, ScheduledTask const& task);
+            void compactTimerHeap();
+
+            std::unordered_map<TimerId, ScheduledTask> _tasks;
+            std::vector<TimerEntry>                    _timerHeap; // min-heap ordered by deadline
+            TimerId                                    _lastTimerId = InvalidTimerId;
+            std::mutex                                 _taskMutex;
+
+            GAMpscQueue<QueuedBlock> _blocks{TASK_QUEUE_CAPACITY};
+
+            struct OverflowBlock
+            {
+                QueuedBlock block;
+                GATaskInfo  info;
+            };
+
+            // used when the ring buffer is full or the overflow policy searches the queue; while set every producer goes through it to keep ordering
+            std::deque<OverflowBlock> _overflowBlocks;
+            std::mutex                _overflowMutex;
+            std::atomic<bool>         _isOverflowing = false;
+
+            // calls in the ring buffer, the overflow queue and the staging buffers combined
+            std::atomic<std::size_t>  _pendingBlocks = 0;
+            std::atomic<std::size_t>  _maxPendingBlocks = DEFAULT_MAX_QUEUED_TASKS;
+            std::atomic<int>          _overflowPolicy = DEFAULT_OVERFLOW_POLICY;
+            std::atomic<std::int64_t> _blockTimeoutMs = DEFAULT_BLOCK_TIMEOUT.count();
+
+            // producers waiting for room with QueueBlockWithTimeout
+            std::mutex                _roomMutex;
+            std::condition_variable   _hasRoom;
+            std::atomic<int>          _waitingProducers = 0;
+
+            std::mutex                                     _dropMutex;
+            std::unordered_map<std::string, std::int64_t>  _droppedTasks;
+
+            std::atomic<bool>                           _isStagingEnabled = false;
+            std::atomic<std::size_t>                    _stagingBatchSize = DEFAULT_STAGING_BATCH_SIZE;
+            std::atomic<std::int64_t>                   _stagingMaxDelayMs = DEFAULT_STAGING_MAX_DELAY.count();
+            std::atomic<bool>                           _hasStagedBlocks = false;
+            std::vector<std::shared_ptr<StagingBuffer>> _stagingBuffers;
+            std::mutex                                  _stagingMutex;
+
+            // stats, each histogram is only written by the thread running that kind of task
+            const TimePoint           _statsStart = Clock::now();
+            std::atomic<std::size_t>  _maxPendingSeen = 0;
+            GALatencyHistogram        _blockWait;
+            GALatencyHistogram        _blockRun;
+            GALatencyHistogram        _timerRun;
+            GALatencyHistogram        _ioWait;
+            GALatencyHistogram        _ioRun;
+
             std::thread       _thread;
-            std::mutex        _blockMutex;
-            std::mutex        _taskMutex;
+            std::once_flag    _startFlag;
+            std::atomic<bool> _isStarted = false;
+            std::atomic<bool> _isExternalPump = false;
+
+            // thread currently consuming blocks, the ga thread or the one calling pump()
+            std::atomic<std::thread::id> _workerId;
+            std::mutex                   _pumpMutex;
+
+            GAThreadSettings  _threadSettings{{}, ThreadSchedulingNormal, 0, DEFAULT_THREAD_NAME};
+            std::mutex        _threadSettingsMutex;
+
+            // signaled whenever a block is queued, a task is scheduled or the thread should end
+            std::mutex              _wakeMutex;
+            std::condition_variable _hasWork;
+            std::atomic<bool>       _isSleeping = false;
+            bool                    _wakeUp = false;
+
             std::atomic<bool> _endThread = false;
             std::atomic<bool> _hasJoined = false;
+
+            // upload lane, only sees a handful of blocks per processing interval
+            std::deque<QueuedBlock> _ioBlocks;
+            std::mutex              _ioMutex;
+            std::condition_variable _hasIOWork;
+            bool                    _endIOThread = false;
+            std::thread             _ioThread;
         };
     }
 }
@@ -397,6 +397,11 @@ namespace gameanalytics
             return compress_string_gzip(data);
         }
 
+        uint32_t GAUtilities::computeCrc32(const void* data, std::size_t size)
+        {
+            return static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, static_cast<const unsigned char*>(data), size));
+        }
+
         // TODO(nikolaj): explain function
         bool GAUtilities::stringVectorContainsString(const StringVector& vector, std::string const& str)
         {
@@ -126,6 +126,7 @@ namespace gameanalytics
             static void hmacWithKey(const char* key, const std::vector<uint8_t>& data, std::vector<uint8_t>& out);
             static bool stringMatch(std::string const& string, std::string const& pattern);
             static std::vector<uint8_t> gzipCompress(const char* data);
+            static uint32_t computeCrc32(const void* data, std::size_t size);
 
             // added for C++ port
             static bool isStringNullOrEmpty(const char* s);
@@ -17,6 +17,7 @@
 #include <cstdlib>
 #include <thread>
 #include <array>
+#include <algorithm>
 #include "stacktrace/call_stack.hpp"
 
 namespace gameanalytics
@@ -27,6 +28,22 @@ namespace gameanalytics
     constexpr std::size_t maxErrMsgSize     = 8182u;
     constexpr std::size_t maxDimensionSize  = 64u;
 
+    // how the event queue treats each kind of call once it is full, anything else is never dropped
+    const threading::GATaskInfo businessTaskInfo          {events::GAEvents::CategoryBusiness,    threading::EGATaskPriority::Normal};
+    const threading::GATaskInfo errorTaskInfo             {events::GAEvents::CategoryError,       threading::EGATaskPriority::Normal};
+    const threading::GATaskInfo resourceTaskInfo          {events::GAEvents::CategoryResource,    threading::EGATaskPriority::Low};
+    const threading::GATaskInfo progressionTaskInfo       {events::GAEvents::CategoryProgression, threading::EGATaskPriority::Low};
+    const threading::GATaskInfo designTaskInfo            {events::GAEvents::CategoryDesign,      threading::EGATaskPriority::Low};
+
+    const threading::GATaskInfo infoLogTaskInfo           {nullptr, threading::EGATaskPriority::High, 1};
+    const threading::GATaskInfo verboseLogTaskInfo        {nullptr, threading::EGATaskPriority::High, 2};
+    const threading::GATaskInfo errorReportingTaskInfo    {nullptr, threading::EGATaskPriority::High, 3};
+    const threading::GATaskInfo eventSubmissionTaskInfo   {nullptr, threading::EGATaskPriority::High, 4};
+    const threading::GATaskInfo customDimension01TaskInfo {nullptr, threading::EGATaskPriority::High, 5};
+    const threading::GATaskInfo customDimension02TaskInfo {nullptr, threading::EGATaskPriority::High, 6};
+    const threading::GATaskInfo customDimension03TaskInfo {nullptr, threading::EGATaskPriority::High, 7};
+    const threading::GATaskInfo globalFieldsTaskInfo      {nullptr, threading::EGATaskPriority::High, 8};
+
     // ----------------------- CONFIGURE ---------------------- //
 
     void GameAnalytics::configureAvailableCustomDimensions01(const StringVector& customDimensions)
@@ -158,6 +175,117 @@ namespace gameanalytics
 
     }
 
+    void GameAnalytics::configureStorageProfile(EGAStorageProfile profile)
+    {
+        if(_endThread)
+        {
+            return;
+        }
+
+        if (isSdkReady(true, false))
+        {
+            logging::GALogger::w("Storage profile must be set before SDK is initialized.");
+            return;
+        }
+
+        store::GAStore::setStorageProfile(profile);
+    }
+
+    void GameAnalytics::configureEventStore(EGAEventStoreType type)
+    {
+        if(_endThread)
+        {
+            return;
+        }
+
+        if (isSdkReady(true, false))
+        {
+            logging::GALogger::w("Event store must be set before SDK is initialized.");
+            return;
+        }
+
+        events::GAEvents::setEventStoreType(type);
+    }
+
+    void GameAnalytics::configureGroupCommit(bool enabled, int maxBatchSize, int maxLatencyMs)
+    {
+        if(maxBatchSize <= 0 || maxLatencyMs < 0)
+        {
+            logging::GALogger::w("Group commit needs a batch size larger than 0 and a max latency of at least 0 ms");
+            return;
+        }
+
+        store::GAStore::setGroupCommit(enabled, static_cast<std::size_t>(maxBatchSize), std::chrono::milliseconds(maxLatencyMs));
+    }
+
+    void GameAnalytics::configureStorageBudget(int maxBytes)
+    {
+        if(maxBytes <= 0)
+        {
+            logging::GALogger::w("Storage budget needs to be larger than 0 bytes");
+            return;
+        }
+
+        events::GAEvents::setStoreBudget(maxBytes);
+    }
+
+    void GameAnalytics::configureCompactEventStorage(bool enabled)
+    {
+        events::GAEvents::setCompactStorage(enabled);
+    }
+
+    void GameAnalytics::configureEventSampling(std::string const& category, std::string const& eventIdPrefix, double sampleRate, EGASamplingMode mode, double maxEventsPerSecond, int burst)
+    {
+        if(sampleRate < 0.0 || sampleRate > 1.0 || maxEventsPerSecond < 0.0 || burst < 0)
+        {
+            logging::GALogger::w("Event sampling needs a sample rate from 0 to 1, a max rate and a burst of at least 0");
+            return;
+        }
+
+        // applied right away, events are sampled on the calling thread
+        events::GAEventSampler::Rule rule;
+        rule.category           = category;
+        rule.eventIdPrefix      = eventIdPrefix;
+        rule.sampleRate         = sampleRate;
+        rule.mode               = mode;
+        rule.maxEventsPerSecond = maxEventsPerSecond;
+        rule.burst              = burst;
+
+        events::GAEvents::sampler().setRule(rule);
+    }
+
+    void GameAnalytics::configureWriteBehindBuffer(bool enabled, int maxEvents, int spillIntervalMs)
+    {
+        if(maxEvents <= 0 || spillIntervalMs <= 0)
+        {
+            logging::GALogger::w("Write-behind buffer needs a max event count and a spill interval larger than 0");
+            return;
+        }
+
+        threading::GAThreading::performTaskOnGAThread(
+            [enabled, maxEvents, spillIntervalMs]()
+            {
+                events::GAEvents::configureWriteBehind(enabled, static_cast<std::size_t>(maxEvents), std::chrono::milliseconds(spillIntervalMs));
+            }
+        );
+    }
+
+    void GameAnalytics::configureDesignEventAggregation(bool enabled, int windowMs)
+    {
+        if(windowMs <= 0)
+        {
+            logging::GALogger::w("Design event aggregation needs a window larger than 0 ms");
+            return;
+        }
+
+        threading::GAThreading::performTaskOnGAThread(
+            [enabled, windowMs]()
+            {
+                events::GAEvents::configureDesignEventAggregation(enabled, std::chrono::milliseconds(windowMs));
+            }
+        );
+    }
+
     void GameAnalytics::configureBuildPlatform(std::string const& platform)
     {
         if(_endThread)
@@ -350,6 +478,59 @@ namespace gameanalytics
 
     // ----------------------- INITIALIZE ---------------------- //
 
+    void GameAnalytics::configureEventQueue(int capacity, EGAQueueOverflowPolicy policy, int blockTimeoutMs)
+    {
+        if(capacity <= 0)
+        {
+            logging::GALogger::w("Event queue capacity must be larger than 0");
+            return;
+        }
+
+        // applied right away, the queue being configured can't be used to configure itself
+        threading::GAThreading::configureQueue(static_cast<std::size_t>(capacity), policy, std::chrono::milliseconds(blockTimeoutMs));
+    }
+
+    void GameAnalytics::configureEventStaging(bool enabled, int batchSize, int maxDelayMs)
+    {
+        if(batchSize <= 0 || maxDelayMs < 0)
+        {
+            logging::GALogger::w("Event staging needs a batch size larger than 0 and a max delay of at least 0 ms");
+            return;
+        }
+
+        threading::GAThreading::configureStaging(enabled, static_cast<std::size_t>(batchSize), std::chrono::milliseconds(maxDelayMs));
+    }
+
+    void GameAnalytics::configureExternalPump(bool enabled)
+    {
+        threading::GAThreading::setExternalPump(enabled);
+    }
+
+    void GameAnalytics::pump(int timeBudgetMs)
+    {
+        if(timeBudgetMs <= 0)
+        {
+            return;
+        }
+
+        threading::GAThreading::pump(std::chrono::milliseconds(timeBudgetMs));
+    }
+
+    void GameAnalytics::configureThreadAffinity(std::vector<int> const& cpus)
+    {
+        threading::GAThreading::setThreadAffinity(cpus);
+    }
+
+    void GameAnalytics::configureThreadScheduling(EGAThreadSchedulingPolicy policy, int niceValue)
+    {
+        threading::GAThreading::setThreadScheduling(policy, niceValue);
+    }
+
+    void GameAnalytics::configureThreadName(std::string const& name)
+    {
+        threading::GAThreading::setThreadName(name);
+    }
+
     void GameAnalytics::initialize(std::string const& gameKey, std::string const& gameSecret)
     {
         if(_endThread)
@@ -422,7 +603,7 @@ namespace gameanalytics
             {
                 logging::GALogger::e("addBusinessEvent - Exception thrown:", e.what());
             }
-        });
+        }, businessTaskInfo);
     }
 
     void GameAnalytics::addResourceEvent(EGAResourceFlowType flowType, std::string const& currency, float amount, std::string const& itemType, std::string const& itemId, std::string const& fields, bool mergeFields)
@@ -432,7 +613,13 @@ namespace gameanalytics
             return;
         }
 
-        threading::GAThreading::performTaskOnGAThread([flowType, currency, amount, itemType, itemId, fields, mergeFields]()
+        double sampleRate = 1.0;
+        if(events::GAEvents::sampler().hasRules() && !events::GAEvents::sampler().admit(events::GAEvents::CategoryResource, currency + ":" + itemType + ":" + itemId, sampleRate))
+        {
+            return;
+        }
+
+        threading::GAThreading::performTaskOnGAThread([flowType, currency, amount, itemType, itemId, fields, mergeFields, sampleRate]()
         {
             if (!isSdkReady(true, true, "Could not add resource event"))
             {
@@ -442,13 +629,13 @@ namespace gameanalytics
             try
             {
                 json fieldsJson = utilities::parseFields(fields);
-                events::GAEvents::addResourceEvent(flowType, currency, amount, itemType, itemId, fieldsJson, mergeFields);
+                events::GAEvents::addResourceEvent(flowType, currency, amount, itemType, itemId, fieldsJson, mergeFields, sampleRate);
             }
             catch (std::exception& e)
             {
                 logging::GALogger::e(e.what());
             }
-        });
+        }, resourceTaskInfo);
     }
 
     void GameAnalytics::addProgressionEvent(EGAProgressionStatus progressionStatus, int score, std::string const& progression01, std::string const& progression02, std::string const& progression03, std::string const& fields, bool mergeFields)
@@ -464,6 +651,25 @@ namespace gameanalytics
             return;
         }
 
+        double sampleRate = 1.0;
+        if(events::GAEvents::sampler().hasRules())
+        {
+            std::string progressionId = progression01;
+            if(!progression02.empty())
+            {
+                progressionId += ":" + progression02;
+                if(!progression03.empty())
+                {
+                    progressionId += ":" + progression03;
+                }
+            }
+
+            if(!events::GAEvents::sampler().admit(events::GAEvents::CategoryProgression, progressionId, sampleRate))
+            {
+                return;
+            }
+        }
+
         threading::GAThreading::performTaskOnGAThread([=]()
         {
             if (!isSdkReady(true, true, "Could not add progression event"))
@@ -475,7 +681,7 @@ namespace gameanalytics
             {
                 // Send to events
                 json fieldsJson = utilities::parseFields(fields);
-                events::GAEvents::addProgressionEvent(progressionStatus, progression01, progression02, progression03, score, true, fieldsJson, mergeFields);
+                events::GAEvents::addProgressionEvent(progressionStatus, progression01, progression02, progression03, score, true, fieldsJson, mergeFields, sampleRate);
             }
             catch(const json::exception& e)
             {
@@ -485,7 +691,7 @@ namespace gameanalytics
             {
                 logging::GALogger::e("Exception thrown: %s", e.what());
             }
-        });
+        }, progressionTaskInfo);
     }
 
     void GameAnalytics::addProgressionEvent(EGAProgressionStatus progressionStatus, std::string const& progression01, std::string const& progression02, std::string const& progression03, std::string const& fields, bool mergeFields)
@@ -506,6 +712,13 @@ namespace gameanalytics
             return;
         }
 
+        // sampled and rate limited before anything is queued
+        double sampleRate = 1.0;
+        if(!events::GAEvents::sampler().admit(events::GAEvents::CategoryDesign, eventId, sampleRate))
+        {
+            return;
+        }
+
         threading::GAThreading::performTaskOnGAThread([=]()
         {
             if (!isSdkReady(true, true, "Could not add design event"))
@@ -516,13 +729,13 @@ namespace gameanalytics
             try
             {
                 json fieldsJson = utilities::parseFields(fields);
-                events::GAEvents::addDesignEvent(eventId, value, true, fieldsJson, mergeFields);
+                events::GAEvents::addDesignEvent(eventId, value, true, fieldsJson, mergeFields, sampleRate);
             }
             catch(json::exception const& e)
             {
                 logging::GALogger::e("addDesignEvent - Failed to parse fields: %s", e.what());
             }
-        });
+        }, designTaskInfo);
     }
 
     void GameAnalytics::addDesignEvent(std::string const& eventId, std::string const& fields, bool mergeFields)
@@ -537,6 +750,19 @@ namespace gameanalytics
             return;
         }
 
+        if(fields.size() > maxFieldsSize)
+        {
+            logging::GALogger::w("Custom fields length exceeded, maximum allowed is %d, fields' size was %d", maxFieldsSize, fields.size());
+            return;
+        }
+
+        // only events which would be queued use up the rate limit
+        double sampleRate = 1.0;
+        if(events::GAEvents::sampler().hasRules() && !events::GAEvents::sampler().admit(events::GAEvents::CategoryError, events::GAEvents::errorSeverityString(severity), sampleRate))
+        {
+            return;
+        }
+
         const std::string message = utilities::trimString(message_, maxErrMsgSize);
 
         std::string function;
@@ -546,12 +772,6 @@ namespace gameanalytics
         
         function = inFunction.first;
         line     = inFunction.second;
-        
-        if(fields.size() > maxFieldsSize)
-        {
-            logging::GALogger::w("Custom fields length exceeded, maximum allowed is %d, fields' size was %d", maxFieldsSize, fields.size());
-            return;
-        }
 
         threading::GAThreading::performTaskOnGAThread([=]()
         {
@@ -563,13 +783,13 @@ namespace gameanalytics
             try
             {
                 json fieldsJson = utilities::parseFields(fields);
-                events::GAEvents::addErrorEvent(severity, message, function, line, fieldsJson, mergeFields);
+                events::GAEvents::addErrorEvent(severity, message, function, line, fieldsJson, mergeFields, false, sampleRate);
             }
             catch(std::exception& e)
             {
                 logging::GALogger::e("Failed to parse custom fields: %s", e.what());
             }
-        });
+        }, errorTaskInfo);
     }
 
     // ------------- SET STATE CHANGES WHILE RUNNING ----------------- //
@@ -593,7 +813,7 @@ namespace gameanalytics
                 logging::GALogger::i("Info logging disabled");
                 logging::GALogger::setInfoLog(flag);
             }
-        });
+        }, infoLogTaskInfo);
     }
 
     void GameAnalytics::setEnabledVerboseLog(bool flag)
@@ -615,7 +835,7 @@ namespace gameanalytics
                 logging::GALogger::i("Verbose logging disabled");
                 logging::GALogger::setVerboseInfoLog(flag);
             }
-        });
+        }, verboseLogTaskInfo);
     }
 
     void GameAnalytics::setEnabledManualSessionHandling(bool flag)
@@ -641,7 +861,7 @@ namespace gameanalytics
         threading::GAThreading::performTaskOnGAThread([flag]()
         {
             state::GAState::setEnableErrorReporting(flag);
-        });
+        }, errorReportingTaskInfo);
     }
 
     void GameAnalytics::setEnabledEventSubmission(bool flag)
@@ -663,7 +883,7 @@ namespace gameanalytics
                 logging::GALogger::i("Event submission disabled");
                 state::GAState::setEnabledEventSubmission(flag);
             }
-        });
+        }, eventSubmissionTaskInfo);
     }
 
     void GameAnalytics::setCustomDimension01(std::string const& dimension_)
@@ -683,7 +903,7 @@ namespace gameanalytics
                 return;
             }
             state::GAState::setCustomDimension01(dimension);
-        });
+        }, customDimension01TaskInfo);
     }
 
     void GameAnalytics::setCustomDimension02(std::string const& dimension_)
@@ -702,7 +922,7 @@ namespace gameanalytics
                 return;
             }
             state::GAState::setCustomDimension02(dimension);
-        });
+        }, customDimension02TaskInfo);
     }
 
     void GameAnalytics::setCustomDimension03(std::string const& dimension_)
@@ -721,7 +941,7 @@ namespace gameanalytics
                 return;
             }
             state::GAState::setCustomDimension03(dimension);
-        });
+        }, customDimension03TaskInfo);
     }
 
     void GameAnalytics::setGlobalCustomEventFields(std::string const& customFields_)
@@ -735,7 +955,7 @@ namespace gameanalytics
         threading::GAThreading::performTaskOnGAThread([fields]()
         {
             state::GAState::setGlobalCustomEventFields(fields);
-        });
+        }, globalFieldsTaskInfo);
     }
 
     std::string GameAnalytics::getRemoteConfigsValueAsString(std::string const& key, std::string const& defaultValue)
@@ -794,6 +1014,106 @@ namespace gameanalytics
         return state::GAState::getAbVariantId();
     }
 
+    namespace
+    {
+        // in external pump mode nobody else runs the sdk work while we wait
+        template<typename T>
+        bool waitForFuture(std::future<T>& future, std::chrono::steady_clock::time_point deadline)
+        {
+            if(!threading::GAThreading::isExternalPump())
+            {
+                return future.wait_until(deadline) == std::future_status::ready;
+            }
+
+            while(future.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+            {
+                const auto now = std::chrono::steady_clock::now();
+                if(now >= deadline)
+                {
+                    return false;
+                }
+
+                const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+                threading::GAThreading::pump(std::clamp(remaining, std::chrono::milliseconds(1), std::chrono::milliseconds(10)));
+            }
+
+            return true;
+        }
+    }
+
+    EGAFlushStatus GameAnalytics::flush(std::chrono::milliseconds timeout)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        if(threading::GAThreading::isGAThread())
+        {
+            logging::GALogger::w("flush can't be called from the SDK thread");
+            return FlushTimedOut;
+        }
+
+        // every call queued before this block has been processed once it runs
+        std::future<void> persisted = whenEventsPersisted();
+        if(!waitForFuture(persisted, deadline))
+        {
+            return FlushTimedOut;
+        }
+
+        // a batch holds at most MaxEventCount events, keep sending while that makes progress
+        while(true)
+        {
+            auto result = std::make_shared<std::promise<std::pair<int64_t, int64_t>>>();
+            std::future<std::pair<int64_t, int64_t>> uploaded = result->get_future();
+
+            threading::GAThreading::performTaskOnGAThread([result]()
+            {
+                events::GAEvents::uploadEvents([result](int64_t before, int64_t after)
+                {
+                    result->set_value({before, after});
+                });
+            });
+
+            if(!waitForFuture(uploaded, deadline))
+            {
+                return FlushPersisted;
+            }
+
+            const auto [before, after] = uploaded.get();
+            if(after == 0)
+            {
+                return FlushUploaded;
+            }
+
+            if(after < 0 || after >= before)
+            {
+                return FlushPersisted;
+            }
+        }
+    }
+
+    std::future<void> GameAnalytics::whenEventsPersisted()
+    {
+        // events other threads still hold in their staging buffers are queued first, the marker goes in behind them
+        auto persisted = std::make_shared<std::promise<void>>();
+        std::future<void> future = persisted->get_future();
+
+        threading::GAThreading::performTaskOnGAThread(
+            [persisted]()
+            {
+                threading::GAThreading::drainStagedBlocks();
+                threading::GAThreading::performTaskOnGAThread(
+                    [persisted]()
+                    {
+                        // the events are in the database once the buffered ones are written and the open write group is committed
+                        events::GAEvents::persistEvents();
+                        persisted->set_value();
+                    }
+                );
+            }
+        );
+
+        return future;
+    }
+
     void GameAnalytics::startSession()
     {
         if(_endThread)
@@ -830,6 +1150,21 @@ namespace gameanalytics
 
     // -------------- SET GAME STATE CHANGES --------------- //
 
+    std::string GameAnalytics::getSdkStats()
+    {
+        json stats = threading::GAThreading::getStats();
+        stats["store_size_bytes"] = events::GAEvents::getStoreSizeBytes();
+        stats["sampled_out"] = events::GAEvents::sampler().getSampledOutCount();
+        stats["rate_limited"] = events::GAEvents::sampler().getRateLimitedCount();
+
+        return stats.dump();
+    }
+
+    int64_t GameAnalytics::getDroppedEventCount(std::string const& category)
+    {
+        return threading::GAThreading::getDroppedTaskCount(category);
+    }
+
     void GameAnalytics::onResume()
     {
         if(_endThread)
@@ -882,7 +1217,15 @@ namespace gameanalytics
 
             while (!threading::GAThreading::isThreadFinished())
             {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if(threading::GAThreading::isExternalPump())
+                {
+                    // there is no ga thread to end the session for us
+                    threading::GAThreading::pump(std::chrono::milliseconds(100));
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
             }
         }
         catch (const std::exception& e)
@@ -951,6 +1294,15 @@ namespace gameanalytics
         }
     }
 
+    void GameAnalytics::enableSdkStatsInHealthEvent(bool value)
+    {
+        events::GAEvents::getInstance().enableSdkStats = value;
+        if(value)
+        {
+            events::GAEvents::getInstance().enableHealthEvent = true;
+        }
+    }
+
     void GameAnalytics::enableMemoryHistogram(bool value)
     {
         GAHealth* healthTracker = device::GADevice::getHealthTracker();
@@ -17,6 +17,12 @@
 #include <sys/socket.h>
 #include <linux/wireless.h>
 #include <ifaddrs.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 struct sigaction gameanalytics::GAPlatformLinux::prevSigAction;
 
@@ -241,10 +247,17 @@ std::string gameanalytics::GAPlatformLinux::getCpuModel() const
     return systemInfo.machine;
 }
 
+gameanalytics::GAPlatformLinux::~GAPlatformLinux()
+{
+    if (_netlinkSocket != -1)
+    {
+        close(_netlinkSocket);
+    }
+}
+
 std::string gameanalytics::GAPlatformLinux::getConnectionType()
 {
     struct ifaddrs* list = nullptr;
-    struct ifaddrs* current = nullptr;
 
     std::string connection = CONNECTION_OFFLINE;
 
@@ -253,39 +266,113 @@ std::string gameanalytics::GAPlatformLinux::getConnectionType()
         return connection;
     }
 
-    current = list;
-    while(current)
+    // one socket for the wireless checks of all interfaces
+    int sock = -1;
+
+    for (struct ifaddrs* current = list; current; current = current->ifa_next)
     {
-        int sock = -1;
-        if (!current->ifa_addr || current->ifa_addr->sa_family != AF_PACKET) 
+        // an interface which is up and has an address, the loopback doesn't count
+        if (!current->ifa_addr || (current->ifa_addr->sa_family != AF_INET && current->ifa_addr->sa_family != AF_INET6))
         {
-            struct iwreq req = {};
-            strncpy(req.ifr_name, current->ifa_name, IFNAMSIZ);
+            continue;
+        }
 
-            int sock = socket(AF_INET, SOCK_STREAM, 0);
-            if (sock == -1) 
-            {
-                connection = CONNECTION_LAN;
-            }
-            else
-            {
-                if (ioctl(sock, SIOCGIWNAME, &req) != -1) 
-                {
-                    connection = CONNECTION_WIFI;
-                }
-            }
+        if ((current->ifa_flags & IFF_LOOPBACK) || !(current->ifa_flags & IFF_UP) || !(current->ifa_flags & IFF_RUNNING))
+        {
+            continue;
+        }
+
+        if (sock == -1)
+        {
+            sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        }
+
+        struct iwreq req = {};
+        strncpy(req.ifr_name, current->ifa_name, IFNAMSIZ - 1);
+
+        if (sock != -1 && ioctl(sock, SIOCGIWNAME, &req) != -1)
+        {
+            connection = CONNECTION_WIFI;
+            break;
         }
 
-        if(sock != -1)
-            close(sock);
+        connection = CONNECTION_LAN;
+    }
 
-        current = current->ifa_next;
+    if (sock != -1)
+    {
+        close(sock);
     }
 
     freeifaddrs(list);
     return connection;
 }
 
+bool gameanalytics::GAPlatformLinux::watchConnection()
+{
+    if (_netlinkSocket != -1)
+    {
+        return true;
+    }
+
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock == -1)
+    {
+        return false;
+    }
+
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1)
+    {
+        close(sock);
+        return false;
+    }
+
+    _netlinkSocket = sock;
+    return true;
+}
+
+bool gameanalytics::GAPlatformLinux::connectionChanged()
+{
+    if (_netlinkSocket == -1)
+    {
+        return false;
+    }
+
+    // any message means something changed, the type is looked up again instead of decoding them
+    bool changed = false;
+    char buffer[4096];
+
+    while (true)
+    {
+        const ssize_t size = recv(_netlinkSocket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (size > 0)
+        {
+            changed = true;
+            continue;
+        }
+
+        // messages were lost when the socket's buffer overflowed
+        if (size == -1 && errno == ENOBUFS)
+        {
+            changed = true;
+            continue;
+        }
+
+        if (size == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        break;
+    }
+
+    return changed;
+}
+
 std::string gameanalytics::GAPlatformLinux::getGpuModel() const 
 {
     return UNKNOWN_VALUE;
@@ -331,6 +418,64 @@ int64_t gameanalytics::GAPlatformLinux::getSysMemoryUsage() const
     return 0;
 }
 
+void gameanalytics::GAPlatformLinux::applyThreadSettings(GAThreadSettings const& settings)
+{
+    const pthread_t self = pthread_self();
+
+    if(!settings.name.empty())
+    {
+        // the kernel limits thread names to 15 characters
+        const std::string name = settings.name.substr(0, 15);
+        if(pthread_setname_np(self, name.c_str()) != 0)
+        {
+            logging::GALogger::w("Failed to set thread name to %s", name.c_str());
+        }
+    }
+
+    if(!settings.cpuAffinity.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+
+        for(int cpu : settings.cpuAffinity)
+        {
+            if(cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+
+        const int err = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+        if(err != 0)
+        {
+            logging::GALogger::w("Failed to set thread affinity: %s", strerror(err));
+        }
+    }
+
+    if(settings.policy != ThreadSchedulingNormal)
+    {
+        sched_param param = {};
+        param.sched_priority = 0;
+
+        const int policy = settings.policy == ThreadSchedulingIdle ? SCHED_IDLE : SCHED_BATCH;
+        const int err = pthread_setschedparam(self, policy, &param);
+        if(err != 0)
+        {
+            logging::GALogger::w("Failed to set thread scheduling policy: %s", strerror(err));
+        }
+    }
+
+    if(settings.niceValue != 0)
+    {
+        // on linux the nice value is per thread when given the thread id
+        const id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+        if(setpriority(PRIO_PROCESS, tid, settings.niceValue) != 0)
+        {
+            logging::GALogger::w("Failed to set thread nice value: %s", strerror(errno));
+        }
+    }
+}
+
 int64_t gameanalytics::GAPlatformLinux::getBootTime() const
 {
     ProcessStat procStat = readProcessStat();
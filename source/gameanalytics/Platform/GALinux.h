@@ -17,6 +17,8 @@ namespace gameanalytics
 	{
 		public:
 
+			~GAPlatformLinux() override;
+
 			std::string getOSVersion()			override;
 			std::string getDeviceManufacturer() override;
 			std::string getBuildPlatform()		override;
@@ -26,6 +28,8 @@ namespace gameanalytics
 			void setupUncaughtExceptionHandler() override;
 
 			virtual std::string getConnectionType() override;
+			virtual bool watchConnection() override;
+			virtual bool connectionChanged() override;
 
 			virtual std::string getCpuModel() 			const override;
 			virtual std::string getGpuModel() 			const override;
@@ -37,10 +41,15 @@ namespace gameanalytics
 
 			virtual int64_t getBootTime() const override;
 
+			virtual void applyThreadSettings(GAThreadSettings const& settings) override;
+
 		private:
 
 			static void signalHandler(int sig, siginfo_t* info, void* context);
 			static struct sigaction prevSigAction;
+
+			// netlink socket subscribed to link and address changes, -1 if not watching
+			int _netlinkSocket = -1;
 	};
 }
 
@@ -4,6 +4,14 @@
 
 namespace gameanalytics
 {
+    struct GAThreadSettings
+    {
+        std::vector<int>          cpuAffinity;
+        EGAThreadSchedulingPolicy policy    = ThreadSchedulingNormal;
+        int                       niceValue = 0;
+        std::string               name;
+    };
+
     class GAPlatform
     {
         public:
@@ -23,6 +31,11 @@ namespace gameanalytics
 
             virtual std::string getConnectionType() = 0;
 
+            // platforms which are notified of network changes start listening here and return true, connectionChanged
+            // then reports whether there was one since its last call. The connection type of the others is polled
+            virtual bool watchConnection() {return false;}
+            virtual bool connectionChanged() {return false;}
+
             virtual std::string getCpuModel() 			const {return "";}
             virtual std::string getGpuModel() 			const {return "";}
             virtual int 		getNumCpuCores() 		const {return -1;}
@@ -33,6 +46,9 @@ namespace gameanalytics
             
             virtual int64_t getBootTime() const {return -1;}
 
+            // applies the settings to the calling thread
+            virtual void applyThreadSettings(GAThreadSettings const&) {}
+
             virtual void onInit();
 
             private:
@@ -0,0 +1,131 @@
+//
+// GA-SDK-CPP
+// Copyright 2015 GameAnalytics. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <string>
+
+#include "GAEventSampler.h"
+
+using gameanalytics::events::GAEventSampler;
+using namespace gameanalytics;
+
+namespace
+{
+    int countAdmitted(GAEventSampler& sampler, std::string const& category, std::string const& eventId, int events)
+    {
+        int admitted = 0;
+        double sampleRate = 0;
+        for (int i = 0; i < events; ++i)
+        {
+            admitted += sampler.admit(category, eventId, sampleRate) ? 1 : 0;
+        }
+        return admitted;
+    }
+}
+
+TEST(GAEventSampler, testRulesMatchLongestPrefix)
+{
+    GAEventSampler sampler;
+
+    double sampleRate = 0;
+    ASSERT_TRUE(sampler.admit("design", "hit:head", sampleRate));
+    ASSERT_EQ(sampleRate, 1.0);
+
+    sampler.setRule({"design", "", 0.5});
+    sampler.setRule({"design", "hit:", 0.0});
+    sampler.setRule({"", "hit:head", 1.0});
+
+    ASSERT_EQ(countAdmitted(sampler, "design", "hit:body", 100), 0);
+    ASSERT_EQ(countAdmitted(sampler, "design", "hit:head", 100), 100);
+    ASSERT_EQ(countAdmitted(sampler, "progression", "hit:body", 100), 100);
+
+    // kept events carry the rate of their rule
+    const int kept = countAdmitted(sampler, "design", "level:start", 1000);
+    ASSERT_GT(kept, 350);
+    ASSERT_LT(kept, 650);
+    ASSERT_TRUE(sampler.admit("design", "hit:head", sampleRate));
+    ASSERT_EQ(sampleRate, 1.0);
+
+    ASSERT_GE(sampler.getSampledOutCount(), 200);
+}
+
+TEST(GAEventSampler, testDeterministicModes)
+{
+    GAEventSampler sampler;
+    sampler.setUserId("user");
+
+    // the same user is either always kept or never
+    sampler.setRule({"design", "", 0.5, SamplePerUser});
+    const int perUser = countAdmitted(sampler, "design", "any", 50);
+    ASSERT_TRUE(perUser == 0 || perUser == 50);
+
+    sampler.setRule({"design", "", 0.5, SamplePerEventId});
+    int keptIds = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        const std::string eventId = "id:" + std::to_string(i);
+        const int kept = countAdmitted(sampler, "design", eventId, 5);
+        ASSERT_TRUE(kept == 0 || kept == 5);
+        keptIds += kept / 5;
+    }
+    ASSERT_GT(keptIds, 50);
+    ASSERT_LT(keptIds, 150);
+}
+
+TEST(GAEventSampler, testRateLimitAndRemoteRules)
+{
+    GAEventSampler sampler;
+
+    // a burst of 10, refilled at one event per second
+    sampler.setRule({"design", "tick", 1.0, SamplePerEvent, 1.0, 10.0});
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 100), 10);
+    ASSERT_EQ(sampler.getRateLimitedCount(), 90);
+
+    // the remote rule replaces the local one with the same category and prefix, the others stay
+    sampler.setRule({"resource", "", 0.0});
+    sampler.setRemoteRules("[{\"category\": \"design\", \"prefix\": \"tick\", \"rate\": 0}, {\"category\": \"design\", \"mode\": \"unknown\"}]");
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 10), 0);
+    ASSERT_EQ(countAdmitted(sampler, "resource", "gold", 10), 0);
+    ASSERT_EQ(countAdmitted(sampler, "design", "other", 10), 10);
+
+    // without the remote config the local rules are back, with a full bucket
+    sampler.setRemoteRules(json());
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 100), 10);
+}
+
+TEST(GAEventSampler, testPerUserWithoutUserId)
+{
+    GAEventSampler sampler;
+
+    // until the user id is known the events are sampled one by one instead of all by the same empty id
+    sampler.setRule({"design", "", 0.5, SamplePerUser});
+    const int kept = countAdmitted(sampler, "design", "any", 1000);
+    ASSERT_GT(kept, 350);
+    ASSERT_LT(kept, 650);
+
+    sampler.setUserId("user");
+    const int perUser = countAdmitted(sampler, "design", "any", 50);
+    ASSERT_TRUE(perUser == 0 || perUser == 50);
+}
+
+TEST(GAEventSampler, testRemoteRefreshKeepsTokens)
+{
+    GAEventSampler sampler;
+
+    const std::string remoteRules = "[{\"category\": \"design\", \"prefix\": \"tick\", \"max_per_second\": 1, \"burst\": 10}]";
+    sampler.setRemoteRules(remoteRules);
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 100), 10);
+
+    // the same config again, or another rule added, leaves the bucket empty
+    sampler.setRemoteRules(remoteRules);
+    sampler.setRule({"resource", "", 0.0});
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 100), 0);
+
+    // a changed limit starts with a full bucket
+    sampler.setRemoteRules("[{\"category\": \"design\", \"prefix\": \"tick\", \"max_per_second\": 1, \"burst\": 5}]");
+    ASSERT_EQ(countAdmitted(sampler, "design", "tick:frame", 100), 5);
+}
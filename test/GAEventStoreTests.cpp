@@ -0,0 +1,201 @@
+//
+// GA-SDK-CPP
+// Copyright 2015 GameAnalytics. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "GALogEventStore.h"
+
+using gameanalytics::store::GALogEventStore;
+using gameanalytics::store::GAStoredEvent;
+
+namespace
+{
+    std::filesystem::path makeLogDirectory(std::string const& name)
+    {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("ga_event_log_" + name);
+        std::filesystem::remove_all(directory);
+        return directory;
+    }
+
+    void appendEvents(GALogEventStore& store, int from, int to)
+    {
+        for (int i = from; i < to; ++i)
+        {
+            ASSERT_TRUE(store.append({"design", "session", std::to_string(i), "{\"id\":" + std::to_string(i) + "}", ""}));
+        }
+    }
+
+    std::vector<std::string> claim(GALogEventStore& store, std::string const& requestId, std::size_t maxEvents)
+    {
+        std::vector<std::string> events;
+        store.claimBatch(requestId, "", maxEvents,
+            [&events](std::string_view event, std::string_view)
+            {
+                events.emplace_back(event);
+            });
+        return events;
+    }
+}
+
+TEST(GAEventStore, testLogClaimAndAck)
+{
+    const std::filesystem::path directory = makeLogDirectory("claim");
+    GALogEventStore store(directory);
+
+    appendEvents(store, 0, 5);
+    ASSERT_EQ(store.size(), 5);
+
+    ASSERT_THAT(claim(store, "a", 3), ::testing::ElementsAre("{\"id\":0}", "{\"id\":1}", "{\"id\":2}"));
+    ASSERT_THAT(claim(store, "b", 3), ::testing::ElementsAre("{\"id\":3}", "{\"id\":4}"));
+    ASSERT_TRUE(claim(store, "c", 3).empty());
+
+    store.ack("a");
+    store.ack("b");
+    ASSERT_EQ(store.size(), 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testLogNackIsRetriedFirst)
+{
+    const std::filesystem::path directory = makeLogDirectory("nack");
+    GALogEventStore store(directory);
+
+    appendEvents(store, 0, 4);
+
+    claim(store, "a", 2);
+    claim(store, "b", 2);
+    store.nack("b");
+    store.nack("a");
+
+    // oldest failed batch first, then the next one
+    ASSERT_THAT(claim(store, "c", 10), ::testing::ElementsAre("{\"id\":0}", "{\"id\":1}"));
+    ASSERT_THAT(claim(store, "d", 10), ::testing::ElementsAre("{\"id\":2}", "{\"id\":3}"));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testLogRecoversAfterReopen)
+{
+    const std::filesystem::path directory = makeLogDirectory("reopen");
+    {
+        GALogEventStore store(directory);
+        appendEvents(store, 0, 4);
+
+        claim(store, "a", 2);
+        store.ack("a");
+
+        // claimed but never acked, as if the app was killed during the upload
+        claim(store, "b", 2);
+        store.sync();
+    }
+
+    GALogEventStore store(directory);
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_THAT(claim(store, "c", 10), ::testing::ElementsAre("{\"id\":2}", "{\"id\":3}"));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testLogDropsTornRecord)
+{
+    const std::filesystem::path directory = makeLogDirectory("torn");
+    {
+        GALogEventStore store(directory);
+        appendEvents(store, 0, 2);
+    }
+
+    // cut the last record in half
+    const std::filesystem::path segment = std::filesystem::directory_iterator(directory)->path();
+    std::filesystem::resize_file(segment, std::filesystem::file_size(segment) - 4);
+
+    GALogEventStore store(directory);
+    ASSERT_EQ(store.size(), 1);
+    ASSERT_THAT(claim(store, "a", 10), ::testing::ElementsAre("{\"id\":0}"));
+
+    // appends continue behind the last valid record
+    appendEvents(store, 2, 3);
+    ASSERT_THAT(claim(store, "b", 10), ::testing::ElementsAre("{\"id\":2}"));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testLogTrimDropsOldestSegments)
+{
+    const std::filesystem::path directory = makeLogDirectory("trim");
+    GALogEventStore store(directory);
+
+    // large enough events to fill a few segments
+    const std::string padding(4000, 'x');
+    for (int i = 0; i < 200; ++i)
+    {
+        ASSERT_TRUE(store.append({"design", "session", std::to_string(i), "{\"id\":" + std::to_string(i) + ",\"p\":\"" + padding + "\"}", ""}));
+    }
+
+    const int64_t before = store.size();
+    const int64_t removed = store.trim(300000);
+
+    ASSERT_GT(removed, 0);
+    ASSERT_LE(store.sizeBytes(), 300000);
+    ASSERT_EQ(store.size(), before - removed);
+
+    // claims go on with the oldest event left
+    std::vector<std::string> events = claim(store, "a", 1);
+    ASSERT_EQ(events.size(), 1u);
+    ASSERT_EQ(events[0].compare(0, 6 + std::to_string(removed).size(), "{\"id\":" + std::to_string(removed)), 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testLogTrimDropsClaimsOfDroppedSegments)
+{
+    const std::filesystem::path directory = makeLogDirectory("trim_claims");
+    GALogEventStore store(directory);
+
+    const std::string padding(4000, 'x');
+    for (int i = 0; i < 200; ++i)
+    {
+        ASSERT_TRUE(store.append({"design", "session", std::to_string(i), "{\"id\":" + std::to_string(i) + ",\"p\":\"" + padding + "\"}", ""}));
+    }
+
+    // one batch waits for a retry and one is in flight, both in the oldest segment
+    ASSERT_EQ(claim(store, "retry", 5).size(), 5u);
+    store.nack("retry");
+    ASSERT_EQ(claim(store, "retry_again", 5).size(), 5u);
+    ASSERT_EQ(claim(store, "in_flight", 5).size(), 5u);
+    store.nack("retry_again");
+
+    const int64_t removed = store.trim(300000);
+    ASSERT_GT(removed, 0);
+
+    // the dropped batches are neither retried nor counted again when their request finishes
+    const int64_t left = store.size();
+    store.ack("in_flight");
+    ASSERT_EQ(store.size(), left);
+
+    std::vector<std::string> events = claim(store, "next", 1);
+    ASSERT_EQ(events.size(), 1u);
+    ASSERT_EQ(events[0].compare(0, 6 + std::to_string(removed).size(), "{\"id\":" + std::to_string(removed)), 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(GAEventStore, testAppendEventJoinsAnnotations)
+{
+    std::string payload = "[";
+    gameanalytics::store::appendEvent(payload, "{\"a\":1}", "");
+    payload += ',';
+    gameanalytics::store::appendEvent(payload, "{\"a\":2}", "\"b\":3");
+    payload += ',';
+    gameanalytics::store::appendEvent(payload, "{}", "\"b\":4");
+    payload += ']';
+
+    ASSERT_EQ(payload, "[{\"a\":1},{\"b\":3,\"a\":2},{\"b\":4}]");
+}
@@ -8,6 +8,10 @@
 
 #include <string>
 #include <vector>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <filesystem>
 
 
 #include <GAHTTPApi.h>
@@ -16,8 +20,42 @@
 #include "GADevice.h"
 #include "GAState.h"
 #include "GAStore.h"
+#include "GASqliteEventStore.h"
 #include "GADevice.h"
+#include "GAThreading.h"
+#include "GAEvents.h"
+#include "GAValidator.h"
+#include "GameAnalytics/GameAnalytics.h"
 
+namespace
+{
+    // the tests open the store in a new directory of their own, so creating the database is covered as well.
+    // Only once per process: the store stays open across --gtest_repeat iterations
+    class GAStoreEnvironment : public ::testing::Environment
+    {
+     public:
+
+        void SetUp() override
+        {
+            if (isSet)
+            {
+                return;
+            }
+
+            const std::filesystem::path writablePath = std::filesystem::temp_directory_path() / ("ga_tests_" + gameanalytics::utilities::GAUtilities::generateUUID());
+            std::filesystem::create_directories(writablePath);
+            gameanalytics::device::GADevice::setWritablePath(writablePath.string());
+
+            isSet = true;
+        }
+
+     private:
+
+        bool isSet = false;
+    };
+
+    ::testing::Environment* const storeEnvironment = ::testing::AddGlobalTestEnvironment(new GAStoreEnvironment);
+}
 
  TEST(GATests, testInitialize)
  {
@@ -34,6 +72,482 @@
      gameanalytics::state::GAState::internalInitialize();
  }
 
+TEST(GATests, testFlushTimesOut)
+{
+    // events stuck behind a busy sdk thread can't be stored in time
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    gameanalytics::threading::GAThreading::performTaskOnGAThread([released]() { released.wait(); });
+
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(gameanalytics::GameAnalytics::flush(std::chrono::milliseconds(50)), gameanalytics::FlushTimedOut);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+    std::future<void> persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    release.set_value();
+
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+}
+
+TEST(GATests, testStoreReusesStatements)
+{
+    // the same sql text runs from one cached statement, parameters must not leak between calls
+    for(int i = 0; i < 3; ++i)
+    {
+        gameanalytics::store::GAStore::setState("test_statement_" + std::to_string(i), std::to_string(i));
+    }
+
+    for(int i = 0; i < 3; ++i)
+    {
+        gameanalytics::json result;
+        gameanalytics::store::GAStore::executeQuerySync("SELECT value FROM ga_state WHERE key = ?;", {"test_statement_" + std::to_string(i)}, result);
+
+        ASSERT_EQ(result.size(), 1u);
+        ASSERT_EQ(result[0]["value"].get<std::string>(), std::to_string(i));
+
+        gameanalytics::store::GAStore::setState("test_statement_" + std::to_string(i), "");
+    }
+
+    gameanalytics::json result;
+    gameanalytics::store::GAStore::executeQuerySync("SELECT value FROM ga_state WHERE key = ?;", {"test_statement_0"}, result);
+    ASSERT_TRUE(result.empty());
+}
+
+TEST(GATests, testStoreRowReader)
+{
+    gameanalytics::store::GAStore::setState("test_row_reader", "text value");
+
+    int rows = 0;
+    const bool ok = gameanalytics::store::GAStore::queryRowsSync("SELECT 42 AS number, 1.5 AS real, value, NULL AS empty_value FROM ga_state WHERE key = ?;", {"test_row_reader"},
+        [&rows](gameanalytics::store::GAStoreRow const& row)
+        {
+            ++rows;
+
+            EXPECT_EQ(row.columnCount(), 4);
+            EXPECT_STREQ(row.columnName(0), "number");
+            EXPECT_EQ(row.getInt64(0), 42);
+            EXPECT_DOUBLE_EQ(row.getDouble(1), 1.5);
+            EXPECT_EQ(row.getText(2), "text value");
+            EXPECT_TRUE(row.isNull(3));
+            return true;
+        });
+
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(rows, 1);
+
+    // returning false stops reading
+    rows = 0;
+    ASSERT_TRUE(gameanalytics::store::GAStore::queryRowsSync("SELECT key FROM ga_state;", {}, [&rows](gameanalytics::store::GAStoreRow const&) { ++rows; return false; }));
+    ASSERT_EQ(rows, 1);
+
+    ASSERT_FALSE(gameanalytics::store::GAStore::queryRowsSync("SELECT missing FROM ga_state;", {}, [](gameanalytics::store::GAStoreRow const&) { return true; }));
+
+    gameanalytics::store::GAStore::setState("test_row_reader", "");
+}
+
+TEST(GATests, testStorageProfile)
+{
+    // the balanced profile is applied by default when the database is opened
+    gameanalytics::json journalMode;
+    gameanalytics::store::GAStore::executeQuerySync("PRAGMA journal_mode;", journalMode);
+    ASSERT_EQ(journalMode.size(), 1u);
+    ASSERT_EQ(journalMode[0]["journal_mode"].get<std::string>(), "wal");
+
+    gameanalytics::json synchronous;
+    gameanalytics::store::GAStore::executeQuerySync("PRAGMA synchronous;", synchronous);
+    ASSERT_EQ(synchronous.size(), 1u);
+    ASSERT_EQ(synchronous[0]["synchronous"].get<int64_t>(), 1);
+}
+
+TEST(GATests, testEventTableSchema)
+{
+    gameanalytics::json version;
+    gameanalytics::store::GAStore::executeQuerySync("PRAGMA user_version;", version);
+    ASSERT_EQ(version.size(), 1u);
+    ASSERT_EQ(version[0]["user_version"].get<int64_t>(), 3);
+
+    // claiming a batch is an index lookup, not a scan of the table
+    std::string plan;
+    gameanalytics::store::GAStore::queryRowsSync("EXPLAIN QUERY PLAN SELECT rowid FROM ga_events WHERE status = 0 ORDER BY client_ts ASC LIMIT 10;", {},
+        [&plan](gameanalytics::store::GAStoreRow const& row)
+        {
+            plan += std::string(row.getText(row.columnCount() - 1)) + "\n";
+            return true;
+        });
+
+    ASSERT_THAT(plan, ::testing::HasSubstr("ga_events_status"));
+    ASSERT_THAT(plan, ::testing::Not(::testing::HasSubstr("TEMP B-TREE")));
+
+    ASSERT_EQ(gameanalytics::store::GAStore::getEventCategoryCode("design"), 6);
+    ASSERT_EQ(gameanalytics::store::GAStore::getEventCategoryCode("unknown"), 0);
+}
+
+TEST(GATests, testStoreEvictsByPriority)
+{
+    gameanalytics::json autoVacuum;
+    gameanalytics::store::GAStore::executeQuerySync("PRAGMA auto_vacuum;", autoVacuum);
+    ASSERT_EQ(autoVacuum.size(), 1u);
+    ASSERT_EQ(autoVacuum[0]["auto_vacuum"].get<int64_t>(), 2);
+
+    auto countEvents = [](const char* category)
+    {
+        gameanalytics::json result;
+        gameanalytics::store::GAStore::executeQuerySync("SELECT COUNT(*) AS count, MIN(client_ts) AS oldest FROM ga_events WHERE session_id = 'test_eviction' AND category = ?;",
+            {std::to_string(gameanalytics::store::GAStore::getEventCategoryCode(category))}, result);
+        return std::make_pair(result[0]["count"].get<int64_t>(), result[0].value("oldest", gameanalytics::json()).is_null() ? int64_t(0) : result[0]["oldest"].get<int64_t>());
+    };
+
+    gameanalytics::store::GASqliteEventStore store;
+
+    const std::string padding(2000, 'x');
+    for (int i = 0; i < 300; ++i)
+    {
+        ASSERT_TRUE(store.append({"design", "test_eviction", std::to_string(1000000000 + i), "{\"p\":\"" + padding + "\"}", ""}));
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_TRUE(store.append({"business", "test_eviction", std::to_string(1000000000 + i), "{}", ""}));
+    }
+
+    const int64_t used = store.sizeBytes();
+    ASSERT_GT(store.trim(used - 200000), 0);
+    ASSERT_LE(store.sizeBytes(), used - 200000);
+
+    // the oldest design events went, business events stay
+    const auto design = countEvents("design");
+    ASSERT_GT(design.first, 0);
+    ASSERT_LT(design.first, 300);
+    ASSERT_GT(design.second, 1000000000);
+    ASSERT_EQ(countEvents("business").first, 5);
+
+    // the freed pages are given back in steps
+    for (int i = 0; i < 100 && store.compact(std::chrono::milliseconds(50)); ++i)
+    {
+    }
+    ASSERT_FALSE(store.compact(std::chrono::milliseconds(50)));
+
+    // events of the same second are evicted one by one, not all of them at once
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_events WHERE session_id = 'test_eviction';");
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_TRUE(store.append({"design", "test_eviction", "1000000000", "{\"p\":\"" + padding + "\"}", ""}));
+    }
+
+    ASSERT_GT(store.trim(store.sizeBytes() - 20000), 0);
+    ASSERT_GT(countEvents("design").first, 50);
+
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_events WHERE session_id = 'test_eviction';");
+}
+
+TEST(GATests, testCompactEventStorage)
+{
+    gameanalytics::store::GASqliteEventStore store;
+
+    // categories without a code of their own keep the sdk's events out of the claim
+    const std::string annotations = "\"device\":\"test\",\"session_id\":\"test_compact\"";
+    ASSERT_TRUE(store.append({"test_compact", "test_compact", "1000000000", "{\"category\":\"test_compact\",\"value\":1}", annotations}));
+    ASSERT_TRUE(store.append({"test_compact", "test_compact", "1000000001", "{}", annotations}));
+
+    // the fragment is stored once
+    gameanalytics::json rows;
+    gameanalytics::store::GAStore::executeQuerySync("SELECT COUNT(*) AS count FROM ga_annotations WHERE fragment = ?;", {annotations}, rows);
+    ASSERT_EQ(rows[0]["count"].get<int64_t>(), 1);
+
+    std::vector<gameanalytics::json> events;
+    ASSERT_EQ(store.claimBatch("test_compact_request", "test_compact", 10,
+        [&events](std::string_view event, std::string_view annotations)
+        {
+            events.push_back(gameanalytics::json::parse(gameanalytics::store::joinEvent(annotations, event)));
+        }), 2);
+    store.ack("test_compact_request");
+
+    ASSERT_EQ(events.size(), 2u);
+    ASSERT_EQ(events[0], gameanalytics::json::parse("{\"category\":\"test_compact\",\"value\":1,\"device\":\"test\",\"session_id\":\"test_compact\"}"));
+    ASSERT_EQ(events[1], gameanalytics::json::parse("{\"device\":\"test\",\"session_id\":\"test_compact\"}"));
+}
+
+TEST(GATests, testStaticAnnotationsAreCached)
+{
+    using gameanalytics::state::GAState;
+
+    // the cache belongs to the ga thread
+    std::future<void> done = gameanalytics::threading::GAThreading::performTaskOnGAThreadWithFuture([]()
+    {
+        std::string const& text = GAState::getStaticAnnotationsText();
+        const std::string before = text;
+        ASSERT_EQ(gameanalytics::json::parse("{" + before + "}"), GAState::getStaticAnnotations());
+
+        // per event fields are not part of it
+        ASSERT_FALSE(GAState::getStaticAnnotations().contains("event_uuid"));
+        ASSERT_FALSE(GAState::getStaticAnnotations().contains("client_ts"));
+
+        // rebuilt only after an input changed
+        ASSERT_EQ(&GAState::getStaticAnnotationsText(), &text);
+        ASSERT_EQ(GAState::getStaticAnnotationsText(), before);
+
+        const std::string build = GAState::getStaticAnnotations().value("build", "");
+        GAState::setBuild("test_annotations");
+        ASSERT_EQ(GAState::getStaticAnnotations()["build"], "test_annotations");
+        ASSERT_NE(GAState::getStaticAnnotationsText(), before);
+
+        GAState::setBuild(build);
+        ASSERT_EQ(GAState::getStaticAnnotationsText(), before);
+
+        gameanalytics::json annotations;
+        GAState::getEventAnnotations(annotations);
+        ASSERT_TRUE(annotations.contains("event_uuid"));
+        ASSERT_TRUE(annotations.contains("session_num"));
+        ASSERT_EQ(annotations["session_id"], GAState::getStaticAnnotations()["session_id"]);
+    });
+
+    ASSERT_EQ(done.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    done.get();
+}
+
+TEST(GATests, testConnectionTypeIsCached)
+{
+    using gameanalytics::device::GADevice;
+
+    std::future<void> done = gameanalytics::threading::GAThreading::performTaskOnGAThreadWithFuture([]()
+    {
+        const std::string connectionType = GADevice::getConnectionType();
+        ASSERT_TRUE(gameanalytics::validators::GAValidator::validateConnectionType(connectionType));
+
+#if IS_LINUX
+        ASSERT_TRUE(GADevice::getPlatform()->watchConnection());
+#endif
+
+        // looked up again only after a network change, or once the poll interval passed
+        ASSERT_FALSE(GADevice::updateConnectionType());
+        ASSERT_EQ(GADevice::getConnectionType(), connectionType);
+    });
+
+    ASSERT_EQ(done.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    done.get();
+}
+
+TEST(GATests, testStoreSizeIsCached)
+{
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_state WHERE key = 'test_store_size';");
+
+    const int64_t before = gameanalytics::store::GAStore::refreshDbUsedBytes();
+    ASSERT_GT(before, 0);
+
+    // the cache is refreshed every few writes, not after each one
+    const std::string padding(100000, 'x');
+    gameanalytics::store::GAStore::executeQuerySync("INSERT OR REPLACE INTO ga_state (key, value) VALUES(?, ?);", {"test_store_size", padding});
+    for (int i = 0; i < 32; ++i)
+    {
+        gameanalytics::store::GAStore::executeQuerySync("INSERT OR REPLACE INTO ga_state (key, value) VALUES(?, ?);", {"test_store_size_writes", std::to_string(i)});
+    }
+
+    const int64_t after = gameanalytics::store::GAStore::getDbUsedBytes();
+    ASSERT_GT(after, before + static_cast<int64_t>(padding.size()) / 2);
+
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_state WHERE key = 'test_store_size';");
+    ASSERT_EQ(gameanalytics::store::GAStore::getDbUsedBytes(), after);
+    ASSERT_LT(gameanalytics::store::GAStore::refreshDbUsedBytes(), after);
+    ASSERT_EQ(gameanalytics::store::GAStore::getDbUsedBytes(), gameanalytics::store::GAStore::refreshDbUsedBytes());
+
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_state WHERE key = 'test_store_size_writes';");
+
+    const gameanalytics::json stats = gameanalytics::json::parse(gameanalytics::GameAnalytics::getSdkStats());
+    ASSERT_TRUE(stats.contains("store_size_bytes"));
+}
+
+TEST(GATests, testGroupCommit)
+{
+    gameanalytics::store::GAStore::setGroupCommit(true, 256, std::chrono::milliseconds(50));
+
+    // writes on the sdk thread are left open for the commit queued behind them
+    std::promise<bool> pending;
+    gameanalytics::threading::GAThreading::performTaskOnGAThread(
+        [&pending]()
+        {
+            gameanalytics::store::GAStore::setState("test_group_commit", "1");
+            gameanalytics::store::GAStore::setState("test_group_commit", "2");
+            pending.set_value(gameanalytics::store::GAStore::hasPendingWrites());
+        }
+    );
+    ASSERT_TRUE(pending.get_future().get());
+
+    std::future<void> persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    // a second connection only sees committed data
+    const std::filesystem::path dbPath = std::filesystem::path(gameanalytics::device::GADevice::getWritablePath()) / "bd624ee6f8e6efb32a054f8d7ba11618" / "ga.sqlite3";
+
+    sqlite3* db = nullptr;
+    ASSERT_EQ(sqlite3_open(dbPath.string().c_str(), &db), SQLITE_OK);
+
+    sqlite3_stmt* statement = nullptr;
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT value FROM ga_state WHERE key = 'test_group_commit';", -1, &statement, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(statement), SQLITE_ROW);
+    ASSERT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(statement, 0)), "2");
+
+    sqlite3_finalize(statement);
+    sqlite3_close(db);
+
+    gameanalytics::store::GAStore::setState("test_group_commit", "");
+    gameanalytics::store::GAStore::setGroupCommit(false, 256, std::chrono::milliseconds(50));
+}
+
+TEST(GATests, testWriteBehindBuffer)
+{
+    auto countEvents = []()
+    {
+        gameanalytics::json result;
+        gameanalytics::store::GAStore::executeQuerySync("SELECT COUNT(*) AS count FROM ga_events;", result);
+        return result[0]["count"].get<int64_t>();
+    };
+
+    gameanalytics::GameAnalytics::configureWriteBehindBuffer(true, 1000, 60000);
+
+    // the event stays in memory
+    auto added = std::make_shared<std::promise<std::pair<int64_t, int64_t>>>();
+    std::future<std::pair<int64_t, int64_t>> addedCounts = added->get_future();
+    gameanalytics::threading::GAThreading::performTaskOnGAThread(
+        [added, countEvents]()
+        {
+            try
+            {
+                const int64_t before = countEvents();
+                gameanalytics::events::GAEvents::addDesignEvent("test:write_behind", 0, false, {}, false);
+                added->set_value({before, countEvents()});
+            }
+            catch(...)
+            {
+                added->set_exception(std::current_exception());
+            }
+        }
+    );
+
+    ASSERT_EQ(addedCounts.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    const std::pair<int64_t, int64_t> counts = addedCounts.get();
+    ASSERT_EQ(counts.second, counts.first);
+
+    // and is written to the database before it counts as persisted
+    std::future<void> persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    ASSERT_EQ(countEvents(), counts.first + 1);
+
+    gameanalytics::GameAnalytics::configureWriteBehindBuffer(false);
+}
+
+TEST(GATests, testDesignEventAggregation)
+{
+    auto findEvents = [](std::string const& eventId)
+    {
+        gameanalytics::json result;
+        gameanalytics::store::GAStore::executeQuerySync("SELECT event FROM ga_events WHERE event LIKE ?;", {"%\"event_id\":\"" + eventId + "\"%"}, result);
+
+        std::vector<gameanalytics::json> events;
+        for (auto const& row : result)
+        {
+            events.push_back(gameanalytics::json::parse(row["event"].get<std::string>()));
+        }
+        return events;
+    };
+
+    gameanalytics::GameAnalytics::configureDesignEventAggregation(true, 60000);
+
+    std::promise<std::size_t> added;
+    gameanalytics::threading::GAThreading::performTaskOnGAThread(
+        [&added, &findEvents]()
+        {
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate", 1, true, {}, false);
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate", 5, true, {}, false);
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate", 3, true, {}, false);
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate_single", 2, true, {}, false);
+            added.set_value(findEvents("test:aggregate").size());
+        }
+    );
+
+    // folded in memory until the window ends or the events are persisted
+    ASSERT_EQ(added.get_future().get(), 0u);
+
+    std::future<void> persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    const std::vector<gameanalytics::json> aggregated = findEvents("test:aggregate");
+    ASSERT_EQ(aggregated.size(), 1u);
+    ASSERT_EQ(aggregated[0]["value"].get<double>(), 9.0);
+    ASSERT_EQ(aggregated[0]["custom_fields"]["ga_count"].get<int64_t>(), 3);
+    ASSERT_EQ(aggregated[0]["custom_fields"]["ga_min"].get<double>(), 1.0);
+    ASSERT_EQ(aggregated[0]["custom_fields"]["ga_max"].get<double>(), 5.0);
+
+    const std::vector<gameanalytics::json> single = findEvents("test:aggregate_single");
+    ASSERT_EQ(single.size(), 1u);
+    ASSERT_EQ(single[0]["value"].get<double>(), 2.0);
+    ASSERT_FALSE(single[0].contains("custom_fields"));
+
+    // count, min and max take the place of the last custom fields, an event which isn't repeated keeps all of them
+    gameanalytics::json fields;
+    for (int i = 0; i < gameanalytics::MAX_CUSTOM_FIELDS_COUNT; ++i)
+    {
+        fields["field_" + std::to_string(i)] = i;
+    }
+
+    gameanalytics::threading::GAThreading::performTaskOnGAThread(
+        [fields]()
+        {
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate_fields", 1, true, fields, false);
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate_fields", 2, true, fields, false);
+            gameanalytics::events::GAEvents::addDesignEvent("test:aggregate_fields_single", 1, true, fields, false);
+        }
+    );
+
+    persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    const std::vector<gameanalytics::json> withFields = findEvents("test:aggregate_fields");
+    ASSERT_EQ(withFields.size(), 1u);
+    ASSERT_EQ(withFields[0]["custom_fields"].size(), static_cast<std::size_t>(gameanalytics::MAX_CUSTOM_FIELDS_COUNT));
+    ASSERT_EQ(withFields[0]["custom_fields"]["ga_count"].get<int64_t>(), 2);
+    ASSERT_EQ(withFields[0]["custom_fields"]["ga_max"].get<double>(), 2.0);
+    ASSERT_TRUE(withFields[0]["custom_fields"].contains("field_0"));
+
+    const std::vector<gameanalytics::json> singleWithFields = findEvents("test:aggregate_fields_single");
+    ASSERT_EQ(singleWithFields.size(), 1u);
+    ASSERT_EQ(singleWithFields[0]["custom_fields"], fields);
+
+    gameanalytics::GameAnalytics::configureDesignEventAggregation(false);
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_events WHERE event LIKE '%\"event_id\":\"test:aggregate%';");
+}
+
+TEST(GATests, testSampleRateFitsCustomFields)
+{
+    // a full set of the caller's own fields
+    gameanalytics::json fields;
+    for (int i = 0; i < gameanalytics::MAX_CUSTOM_FIELDS_COUNT; ++i)
+    {
+        fields["field_" + std::to_string(i)] = i;
+    }
+
+    gameanalytics::threading::GAThreading::performTaskOnGAThread(
+        [fields]()
+        {
+            gameanalytics::events::GAEvents::addDesignEvent("test:sample_rate", 1, true, fields, false, 0.25);
+        }
+    );
+
+    std::future<void> persisted = gameanalytics::GameAnalytics::whenEventsPersisted();
+    ASSERT_EQ(persisted.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    gameanalytics::json result;
+    gameanalytics::store::GAStore::executeQuerySync("SELECT event FROM ga_events WHERE event LIKE '%\"event_id\":\"test:sample_rate\"%';", result);
+    ASSERT_EQ(result.size(), 1u);
+
+    // one of the caller's fields makes room for the rate, which is never dropped
+    const gameanalytics::json event = gameanalytics::json::parse(result[0]["event"].get<std::string>());
+    ASSERT_EQ(event["custom_fields"].size(), static_cast<std::size_t>(gameanalytics::MAX_CUSTOM_FIELDS_COUNT));
+    ASSERT_EQ(event["custom_fields"]["ga_sample_rate"].get<double>(), 0.25);
+
+    gameanalytics::store::GAStore::executeQuerySync("DELETE FROM ga_events WHERE event LIKE '%\"event_id\":\"test:sample_rate\"%';");
+}
+
 // TEST(GATests, testCompress)
 // {
 //     std::string data = "Hello world!";
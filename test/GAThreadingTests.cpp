@@ -0,0 +1,564 @@
+//
+// GA-SDK-CPP
+// Copyright 2015 GameAnalytics. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "GAThreading.h"
+#include "GAState.h"
+
+using namespace gameanalytics;
+using namespace std::chrono_literals;
+
+TEST(GAThreading, testBlockRunsWithoutPollingDelay)
+{
+    // warm up, makes sure the thread is running
+    {
+        std::promise<void> ready;
+        threading::GAThreading::performTaskOnGAThread([&ready]() { ready.set_value(); });
+        ASSERT_EQ(ready.get_future().wait_for(5s), std::future_status::ready);
+    }
+
+    for(int i = 0; i < 10; ++i)
+    {
+        std::promise<void> done;
+        std::future<void> f = done.get_future();
+
+        threading::GAThreading::performTaskOnGAThread([&done]() { done.set_value(); });
+
+        // the worker is woken up directly, it does not wait for a polling interval
+        ASSERT_EQ(f.wait_for(50ms), std::future_status::ready);
+    }
+}
+
+TEST(GAThreading, testScheduledTimerWakesUpWorker)
+{
+    // the timer keeps running after the test finishes, so it must not reference the stack
+    auto ticks = std::make_shared<std::atomic<int>>(0);
+
+    const auto id = threading::GAThreading::scheduleTimer(20ms, [ticks]() { ++(*ticks); });
+    ASSERT_NE(id, threading::GAThreading::InvalidTimerId);
+
+    const auto start = std::chrono::steady_clock::now();
+    while(*ticks < 3 && (std::chrono::steady_clock::now() - start) < 5s)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+
+    ASSERT_TRUE(threading::GAThreading::cancelTimer(id));
+    ASSERT_GE(ticks->load(), 3);
+}
+
+TEST(GAThreading, testCancelTimer)
+{
+    auto ticks = std::make_shared<std::atomic<int>>(0);
+
+    const auto id = threading::GAThreading::scheduleTimer(10ms, [ticks]() { ++(*ticks); });
+
+    const auto start = std::chrono::steady_clock::now();
+    while(*ticks < 1 && (std::chrono::steady_clock::now() - start) < 5s)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+
+    ASSERT_TRUE(threading::GAThreading::cancelTimer(id));
+    ASSERT_FALSE(threading::GAThreading::cancelTimer(id));
+    ASSERT_FALSE(threading::GAThreading::rescheduleTimer(id, 10ms));
+
+    // a tick which was already collected when cancelling may still run once
+    std::this_thread::sleep_for(20ms);
+    const int ticksAfterCancel = *ticks;
+
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(ticks->load(), ticksAfterCancel);
+}
+
+TEST(GAThreading, testRescheduleTimer)
+{
+    auto ticks = std::make_shared<std::atomic<int>>(0);
+
+    // far enough in the future to never fire on its own during the test
+    const auto id = threading::GAThreading::scheduleTimer(1h, [ticks]() { ++(*ticks); });
+
+    std::this_thread::sleep_for(50ms);
+    ASSERT_EQ(ticks->load(), 0);
+
+    ASSERT_TRUE(threading::GAThreading::rescheduleTimer(id, 10ms));
+
+    const auto start = std::chrono::steady_clock::now();
+    while(*ticks < 2 && (std::chrono::steady_clock::now() - start) < 5s)
+    {
+        std::this_thread::sleep_for(5ms);
+    }
+
+    ASSERT_TRUE(threading::GAThreading::cancelTimer(id));
+    ASSERT_GE(ticks->load(), 2);
+}
+
+TEST(GAThreading, testTaskIsMoveOnly)
+{
+    auto counter = std::make_shared<int>(0);
+    auto owned   = std::make_unique<int>(5);
+
+    threading::GATask task([counter, value = std::move(owned)]() { *counter += *value; });
+    ASSERT_TRUE(static_cast<bool>(task));
+
+    threading::GATask moved(std::move(task));
+    ASSERT_FALSE(static_cast<bool>(task));
+
+    moved();
+    ASSERT_EQ(*counter, 5);
+
+    // closures larger than the inline storage still work
+    std::array<char, threading::GATask::InlineSize * 2> big = {};
+    big[0] = 2;
+
+    threading::GATask large([counter, big]() { *counter += big[0]; });
+    task = std::move(large);
+    task();
+    ASSERT_EQ(*counter, 7);
+
+    task.reset();
+    ASSERT_EQ(counter.use_count(), 2);
+}
+
+TEST(GAThreading, testMpscQueueKeepsPerProducerOrder)
+{
+    constexpr int numProducers = 4;
+    constexpr int numItems     = 10000;
+
+    threading::GAMpscQueue<std::pair<int, int>> queue(1000);
+    ASSERT_EQ(queue.capacity(), 1024u);
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back([&queue, p]()
+        {
+            for(int i = 0; i < numItems; ++i)
+            {
+                while(!queue.tryPush({p, i}))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::array<int, numProducers> next = {};
+    int received = 0;
+
+    std::pair<int, int> item;
+    while(received < numProducers * numItems)
+    {
+        if(queue.tryPop(item))
+        {
+            ASSERT_EQ(item.second, next[item.first]);
+            ++next[item.first];
+            ++received;
+        }
+    }
+
+    for(auto& t : producers)
+    {
+        t.join();
+    }
+
+    ASSERT_TRUE(queue.empty());
+}
+
+TEST(GAThreading, testOverflowKeepsOrder)
+{
+    // queue a lot more blocks than the ring buffer holds while the worker is busy
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    threading::GAThreading::performTaskOnGAThread([released]() { released.wait(); });
+
+    constexpr int numBlocks = 5000;
+    auto order = std::make_shared<std::vector<int>>();
+
+    for(int i = 0; i < numBlocks; ++i)
+    {
+        threading::GAThreading::performTaskOnGAThread([order, i]() { order->push_back(i); });
+    }
+
+    std::promise<void> done;
+    threading::GAThreading::performTaskOnGAThread([&done]() { done.set_value(); });
+
+    release.set_value();
+    ASSERT_EQ(done.get_future().wait_for(5s), std::future_status::ready);
+
+    ASSERT_EQ(order->size(), static_cast<size_t>(numBlocks));
+    for(int i = 0; i < numBlocks; ++i)
+    {
+        ASSERT_EQ((*order)[i], i);
+    }
+}
+
+TEST(GAThreading, testIOThreadDoesNotBlockGAThread)
+{
+    // simulate a hung upload on the io lane
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    std::promise<std::thread::id> ioThread;
+    threading::GAThreading::performTaskOnIOThread([released, &ioThread]()
+    {
+        ioThread.set_value(std::this_thread::get_id());
+        released.wait();
+    });
+
+    std::promise<std::thread::id> gaThread;
+    std::future<std::thread::id> f = gaThread.get_future();
+    threading::GAThreading::performTaskOnGAThread([&gaThread]() { gaThread.set_value(std::this_thread::get_id()); });
+
+    ASSERT_EQ(f.wait_for(1s), std::future_status::ready);
+
+    release.set_value();
+    ASSERT_NE(f.get(), ioThread.get_future().get());
+}
+
+TEST(GAThreading, testQueueOverflowPolicies)
+{
+    // keep the worker busy so everything below stays queued
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    threading::GAThreading::performTaskOnGAThread([released, &started]() { started.set_value(); released.wait(); });
+    ASSERT_EQ(started.get_future().wait_for(5s), std::future_status::ready);
+
+    // the drop counts are kept for the whole process
+    const int64_t droppedLow    = threading::GAThreading::getDroppedTaskCount("test_low");
+    const int64_t droppedNormal = threading::GAThreading::getDroppedTaskCount("test_normal");
+
+    // smaller than the ring buffer, every queued block can still be searched
+    constexpr int capacity = 100;
+    threading::GAThreading::configureQueue(capacity, QueueDropOldestLowPriority, 0ms);
+
+    auto ran = std::make_shared<std::vector<std::string>>();
+
+    const threading::GATaskInfo lowInfo    {"test_low",    threading::EGATaskPriority::Low};
+    const threading::GATaskInfo normalInfo {"test_normal", threading::EGATaskPriority::Normal};
+
+    for(int i = 0; i < capacity; ++i)
+    {
+        threading::GAThreading::performTaskOnGAThread([ran, i]() { ran->push_back("low " + std::to_string(i)); }, lowInfo);
+    }
+
+    // evicts the oldest low priority blocks
+    for(int i = 0; i < 10; ++i)
+    {
+        threading::GAThreading::performTaskOnGAThread([ran]() { ran->push_back("normal"); }, normalInfo);
+    }
+
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_low") - droppedLow, 10);
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_normal") - droppedNormal, 0);
+
+    // replaces the pending setting instead of growing the queue
+    threading::GAThreading::configureQueue(capacity, QueueCoalesce, 0ms);
+
+    const threading::GATaskInfo settingInfo {nullptr, threading::EGATaskPriority::High, 1000};
+    threading::GAThreading::performTaskOnGAThread([ran]() { ran->push_back("setting 1"); }, settingInfo);
+    threading::GAThreading::performTaskOnGAThread([ran]() { ran->push_back("setting 2"); }, settingInfo);
+
+    // anything else is dropped
+    threading::GAThreading::configureQueue(capacity, QueueDropNewest, 0ms);
+    threading::GAThreading::performTaskOnGAThread([ran]() { ran->push_back("normal"); }, normalInfo);
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_normal") - droppedNormal, 1);
+
+    std::promise<void> done;
+    threading::GAThreading::performTaskOnGAThread([&done]() { done.set_value(); });
+
+    release.set_value();
+    ASSERT_EQ(done.get_future().wait_for(5s), std::future_status::ready);
+
+    ASSERT_EQ(ran->size(), static_cast<size_t>(capacity + 1));
+    ASSERT_EQ(ran->front(), "low 10");
+    ASSERT_EQ((*ran)[capacity - 11], "low " + std::to_string(capacity - 1));
+    ASSERT_EQ(std::count(ran->begin(), ran->end(), "normal"), 10);
+    ASSERT_EQ(std::count(ran->begin(), ran->end(), "setting 1"), 0);
+    ASSERT_EQ(std::count(ran->begin(), ran->end(), "setting 2"), 1);
+
+    threading::GAThreading::configureQueue(8192, QueueDropNewest, 100ms);
+}
+
+TEST(GAThreading, testBlockedProducersRespectCapacity)
+{
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    threading::GAThreading::performTaskOnGAThread([released, &started]() { started.set_value(); released.wait(); });
+    ASSERT_EQ(started.get_future().wait_for(5s), std::future_status::ready);
+
+    const int64_t dropped = threading::GAThreading::getDroppedTaskCount("test_blocked");
+
+    constexpr int capacity = 4;
+    constexpr int numProducers = 8;
+    constexpr int blocksPerProducer = 20;
+    threading::GAThreading::configureQueue(capacity, QueueBlockWithTimeout, 5000ms);
+
+    // every block runs while the others are still waiting for room, a freed slot must only let one of them in
+    auto maxDepth = std::make_shared<std::atomic<int64_t>>(0);
+    auto remaining = std::make_shared<std::atomic<int>>(numProducers * blocksPerProducer);
+    auto done = std::make_shared<std::promise<void>>();
+
+    const threading::GATaskInfo info {"test_blocked", threading::EGATaskPriority::Normal};
+    auto block = [maxDepth, remaining, done]()
+    {
+        const int64_t depth = threading::GAThreading::getStats()["queue_depth"].get<int64_t>();
+        int64_t seen = maxDepth->load();
+        while(depth > seen && !maxDepth->compare_exchange_weak(seen, depth))
+        {
+        }
+
+        std::this_thread::sleep_for(100us);
+        if(--*remaining == 0)
+        {
+            done->set_value();
+        }
+    };
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back([&block, &info]()
+        {
+            for(int i = 0; i < blocksPerProducer; ++i)
+            {
+                threading::GAThreading::performTaskOnGAThread(block, info);
+            }
+        });
+    }
+
+    // let the producers fill the queue and start waiting
+    std::this_thread::sleep_for(50ms);
+    release.set_value();
+
+    for(std::thread& t : producers)
+    {
+        t.join();
+    }
+
+    ASSERT_EQ(done->get_future().wait_for(5s), std::future_status::ready);
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_blocked") - dropped, 0);
+    ASSERT_LE(maxDepth->load(), capacity);
+
+    threading::GAThreading::configureQueue(8192, QueueDropNewest, 100ms);
+}
+
+TEST(GAThreading, testTaskFuture)
+{
+    auto ran = std::make_shared<std::atomic<bool>>(false);
+
+    std::future<void> f = threading::GAThreading::performTaskOnGAThreadWithFuture([ran]() { *ran = true; });
+    ASSERT_EQ(f.wait_for(5s), std::future_status::ready);
+    ASSERT_TRUE(ran->load());
+
+    // errors are reported through the future
+    std::future<void> failed = threading::GAThreading::performTaskOnGAThreadWithFuture([]() { throw std::runtime_error("failed"); });
+    ASSERT_THROW(failed.get(), std::runtime_error);
+
+    // a dropped block breaks its future
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    threading::GAThreading::performTaskOnGAThread([released]() { released.wait(); });
+
+    threading::GAThreading::configureQueue(1, QueueDropNewest, 0ms);
+
+    std::future<void> filler  = threading::GAThreading::performTaskOnGAThreadWithFuture([]() {});
+    std::future<void> dropped = threading::GAThreading::performTaskOnGAThreadWithFuture([]() {}, {"test_future", threading::EGATaskPriority::Low});
+
+    threading::GAThreading::configureQueue(8192, QueueDropNewest, 100ms);
+    release.set_value();
+
+    ASSERT_EQ(filler.wait_for(5s), std::future_status::ready);
+    ASSERT_THROW(dropped.get(), std::future_error);
+}
+
+TEST(GAThreading, testStaging)
+{
+    threading::GAThreading::configureStaging(true, 16, 20ms);
+
+    constexpr int Producers = 4;
+    constexpr int PerProducer = 100;
+
+    std::mutex order;
+    std::array<std::vector<int>, Producers> ran;
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < Producers; ++p)
+    {
+        producers.emplace_back(
+            [p, &order, &ran]()
+            {
+                for(int i = 0; i < PerProducer; ++i)
+                {
+                    threading::GAThreading::performTaskOnGAThread(
+                        [p, i, &order, &ran]()
+                        {
+                            std::lock_guard<std::mutex> guard(order);
+                            ran[p].push_back(i);
+                        },
+                        {"test_staging", threading::EGATaskPriority::Low}
+                    );
+                }
+            }
+        );
+    }
+
+    for(std::thread& t : producers)
+    {
+        t.join();
+    }
+
+    // a partial batch is taken after the max delay, each thread's events keep their order
+    std::this_thread::sleep_for(200ms);
+    {
+        std::lock_guard<std::mutex> guard(order);
+        for(const std::vector<int>& r : ran)
+        {
+            ASSERT_EQ(r.size(), static_cast<std::size_t>(PerProducer));
+            ASSERT_TRUE(std::is_sorted(r.begin(), r.end()));
+        }
+    }
+
+    // staged blocks run before a block queued right away by the same thread
+    std::vector<int> sequence;
+    threading::GAThreading::performTaskOnGAThread([&sequence]() { sequence.push_back(1); }, {"test_staging", threading::EGATaskPriority::Low});
+    std::future<void> f = threading::GAThreading::performTaskOnGAThreadWithFuture([&sequence]() { sequence.push_back(2); });
+    ASSERT_EQ(f.wait_for(5s), std::future_status::ready);
+    ASSERT_EQ(sequence, (std::vector<int>{1, 2}));
+
+    threading::GAThreading::configureStaging(false, 64, 20ms);
+}
+
+TEST(GAThreading, testStagingRespectsQueueCapacity)
+{
+    // keep the worker busy so the staged batches stay queued
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    threading::GAThreading::performTaskOnGAThread([released, &started]() { started.set_value(); released.wait(); });
+    ASSERT_EQ(started.get_future().wait_for(5s), std::future_status::ready);
+
+    // the drop counts are kept for the whole process
+    const int64_t dropped = threading::GAThreading::getDroppedTaskCount("test_staging_capacity");
+
+    constexpr int capacity = 100;
+    threading::GAThreading::configureQueue(capacity, QueueDropNewest, 0ms);
+    threading::GAThreading::configureStaging(true, 16, 20ms);
+
+    // full batches are handed over while the worker is stalled, each staged block counts against the capacity
+    auto ran = std::make_shared<std::atomic<int>>(0);
+    for(int i = 0; i < 3 * capacity; ++i)
+    {
+        threading::GAThreading::performTaskOnGAThread([ran]() { ++*ran; }, {"test_staging_capacity", threading::EGATaskPriority::Low});
+    }
+
+    ASSERT_EQ(threading::GAThreading::getStats()["queue_depth"].get<std::size_t>(), static_cast<std::size_t>(capacity));
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_staging_capacity") - dropped, 2 * capacity);
+
+    threading::GAThreading::configureStaging(false, 64, 20ms);
+
+    // this thread still has staged blocks and the queue is full: waiting for room must not keep the ga thread from draining them
+    threading::GAThreading::configureQueue(capacity, QueueBlockWithTimeout, 5000ms);
+
+    std::thread releaser([&release]() { std::this_thread::sleep_for(50ms); release.set_value(); });
+
+    const auto start = std::chrono::steady_clock::now();
+    std::future<void> f = threading::GAThreading::performTaskOnGAThreadWithFuture([ran]() { ++*ran; }, {"test_staging_capacity", threading::EGATaskPriority::Normal});
+    ASSERT_LT(std::chrono::steady_clock::now() - start, 2s);
+
+    releaser.join();
+    ASSERT_EQ(f.wait_for(5s), std::future_status::ready);
+
+    ASSERT_EQ(ran->load(), capacity + 1);
+    ASSERT_EQ(threading::GAThreading::getDroppedTaskCount("test_staging_capacity") - dropped, 2 * capacity);
+
+    threading::GAThreading::configureQueue(8192, QueueDropNewest, 100ms);
+}
+
+TEST(GAThreading, testStats)
+{
+    std::future<void> f = threading::GAThreading::performTaskOnGAThreadWithFuture([]() { std::this_thread::sleep_for(2ms); });
+    ASSERT_EQ(f.wait_for(5s), std::future_status::ready);
+
+    // the run time is recorded right after the block returns
+    std::this_thread::sleep_for(10ms);
+
+    const json stats = threading::GAThreading::getStats();
+
+    ASSERT_GE(stats["block_run"]["count"].get<int64_t>(), 1);
+    ASSERT_GE(stats["block_run"]["max_us"].get<int64_t>(), 2000);
+    ASSERT_GE(stats["max_stall_ms"].get<double>(), 2.0);
+    ASSERT_GE(stats["queue_depth_max"].get<int64_t>(), 1);
+    ASSERT_GT(stats["tasks_per_second"].get<double>(), 0.0);
+    ASSERT_TRUE(stats["io_wait"].contains("p99_us"));
+}
+
+TEST(GAThreading, testLatencyHistogram)
+{
+    threading::GALatencyHistogram histogram;
+
+    for(int i = 0; i < 99; ++i)
+    {
+        histogram.record(3us);
+    }
+    histogram.record(1ms);
+
+    const json out = histogram.toJson();
+
+    ASSERT_EQ(out["count"].get<int64_t>(), 100);
+    ASSERT_EQ(out["max_us"].get<int64_t>(), 1000);
+    ASSERT_EQ(out["p50_us"].get<int64_t>(), 4);
+    ASSERT_EQ(out["p99_us"].get<int64_t>(), 4);
+    ASSERT_EQ(histogram.max(), 1ms);
+}
+
+#if defined(__linux__)
+TEST(GAThreading, testThreadSettings)
+{
+    threading::GAThreading::setThreadName("ga-test");
+    threading::GAThreading::setThreadAffinity({0});
+
+    // settings are applied by blocks queued ahead of this one
+    auto name = std::make_shared<std::array<char, 16>>();
+    auto cpus = std::make_shared<cpu_set_t>();
+
+    std::future<void> f = threading::GAThreading::performTaskOnGAThreadWithFuture([name, cpus]()
+    {
+        pthread_getname_np(pthread_self(), name->data(), name->size());
+        sched_getaffinity(0, sizeof(cpu_set_t), cpus.get());
+    });
+    ASSERT_EQ(f.wait_for(5s), std::future_status::ready);
+
+    ASSERT_STREQ(name->data(), "ga-test");
+    ASSERT_EQ(CPU_COUNT(cpus.get()), 1);
+    ASSERT_TRUE(CPU_ISSET(0, cpus.get()));
+
+    std::vector<int> all;
+    for(unsigned i = 0; i < std::thread::hardware_concurrency(); ++i)
+    {
+        all.push_back(static_cast<int>(i));
+    }
+
+    threading::GAThreading::setThreadAffinity(all);
+    threading::GAThreading::setThreadName("GA-SDK");
+}
+#endif